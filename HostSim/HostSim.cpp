@@ -0,0 +1,702 @@
+/******************************************************************************
+Host-side PIC32 peripheral simulator. See HostSim.h and plib.h.
+******************************************************************************/
+
+#include "plib.h"
+#include "HostSim.h"
+
+#define NEVER	UINT64_MAX
+
+/** Interrupt handlers the library may define. Weak so that a program only
+    has to link the library it is testing. */
+extern "C" {
+	void IntOC4Handler(void) __attribute__((weak));
+	void IntOC5Handler(void) __attribute__((weak));
+	void IntDMA0Handler(void) __attribute__((weak));
+	void IntDMA1Handler(void) __attribute__((weak));
+	void IntDMA2Handler(void) __attribute__((weak));
+	void IntDMA3Handler(void) __attribute__((weak));
+}
+
+/** Register ids used by SimReg */
+#define REG_PORT	0
+#define REG_LAT		1
+#define REG_TRIS	2
+
+#define OP_WRITE	0
+#define OP_SET		1
+#define OP_CLR		2
+#define OP_INV		3
+
+struct SimPort {
+	unsigned int lat;
+	unsigned int tris;
+	unsigned int periph;		// levels driven by peripherals
+	unsigned int periphMask;	// pins currently owned by a peripheral
+};
+
+struct SimTimer {
+	int on;
+	unsigned int prescale;
+	unsigned int period;		// PRx
+	uint64_t start;
+};
+
+struct SimOC {
+	int on;
+	int timer;					// 2 or 3
+	unsigned int r;				// OCxR:  rising edge
+	unsigned int rs;			// OCxRS: falling edge
+	int intOn;
+	int vector;
+	int port;
+	unsigned int pin;
+	uint64_t start;
+};
+
+struct SimSpi {
+	int on;
+	unsigned int bits;
+	uint64_t wordCycles;
+	int txValid;
+	unsigned int txWord;
+	int shiftValid;
+	unsigned int shiftWord;
+	uint64_t shiftEnd;
+	unsigned long words;
+	int sdoPort;
+	unsigned int sdoPin;
+	int sckPort;
+	unsigned int sckPin;
+};
+
+struct SimDma {
+	int enabled;
+	int irq;					// start event
+	int intOn;
+	unsigned int evEnable;
+	unsigned int evFlags;
+	const unsigned char* src;
+	int srcSize;
+	int cellSize;
+	int offset;
+	volatile void* dst;
+};
+
+static uint64_t sim_now;
+static SimPort sim_ports[SIM_NUM_PORTS] = {
+	{0, 0xFFFF, 0, 0}, {0, 0xFFFF, 0, 0}, {0, 0xFFFF, 0, 0}, {0, 0xFFFF, 0, 0},
+	{0, 0xFFFF, 0, 0}, {0, 0xFFFF, 0, 0}, {0, 0xFFFF, 0, 0}
+};
+static SimPinListener* sim_listeners[SIM_MAX_LISTENERS];
+static int sim_numListeners;
+static unsigned long sim_portWrites;
+
+static SimTimer sim_timer2, sim_timer3;
+static SimOC sim_oc1 = {0, 2, 0, 0, 0, SIM_VECTOR_OC1, SIM_OC1_PORT, SIM_OC1_PIN, 0};
+static SimOC sim_oc4 = {0, 3, 0, 0, 0, SIM_VECTOR_OC4, SIM_OC4_PORT, SIM_OC4_PIN, 0};
+static SimOC sim_oc5 = {0, 3, 0, 0, 0, SIM_VECTOR_OC5, SIM_OC5_PORT, SIM_OC5_PIN, 0};
+static SimSpi sim_spi[3] = {
+	{0},
+	{0, 32, 0, 0, 0, 0, 0, 0, 0, SIM_SDO1_PORT, SIM_SDO1_PIN, SIM_SCK1_PORT, SIM_SCK1_PIN},
+	{0, 32, 0, 0, 0, 0, 0, 0, 0, SIM_SDO2_PORT, SIM_SDO2_PIN, SIM_SCK2_PORT, SIM_SCK2_PIN}
+};
+
+static SimDma sim_dma[SIM_NUM_DMA];
+
+volatile unsigned int SPI1BUF;
+volatile unsigned int SPI2BUF;
+
+static int sim_pending[SIM_NUM_VECTORS];
+static unsigned long sim_isrCount[SIM_NUM_VECTORS];
+static int sim_inIsr;
+
+
+/******************************************************************************
+ Pins
+******************************************************************************/
+
+static unsigned int pinLevels(int port)
+{
+	SimPort& p = sim_ports[port];
+	return (p.lat & ~p.periphMask) | (p.periph & p.periphMask);
+}
+
+static void notifyPins(int port, unsigned int before)
+{
+	unsigned int after = pinLevels(port);
+	if (after == before) return;
+
+	for (int i = 0; i < sim_numListeners; i++) {
+		sim_listeners[i]->pinsChanged(port, before, after);
+	}
+}
+
+static void writeLat(int port, unsigned int value)
+{
+	unsigned int before = pinLevels(port);
+	sim_ports[port].lat = value & 0xFFFF;
+	notifyPins(port, before);
+}
+
+static void writeTris(int port, unsigned int value)
+{
+	unsigned int before = sim_ports[port].tris;
+	sim_ports[port].tris = value & 0xFFFF;
+	if (before == sim_ports[port].tris) return;
+
+	for (int i = 0; i < sim_numListeners; i++) {
+		sim_listeners[i]->trisChanged(port, before, sim_ports[port].tris);
+	}
+}
+
+/** Hand a pin over to a peripheral (or give it back to the latch) */
+static void claimPin(int port, unsigned int pin, int claim)
+{
+	unsigned int before = pinLevels(port);
+	if (claim) {
+		sim_ports[port].periphMask |= pin;
+	} else {
+		sim_ports[port].periphMask &= ~pin;
+	}
+	notifyPins(port, before);
+}
+
+static void drivePin(int port, unsigned int pin, int level)
+{
+	unsigned int before = pinLevels(port);
+	if (level) {
+		sim_ports[port].periph |= pin;
+	} else {
+		sim_ports[port].periph &= ~pin;
+	}
+	notifyPins(port, before);
+}
+
+SimReg::operator unsigned int() const
+{
+	switch (reg) {
+		case REG_PORT:
+			return (op == OP_WRITE) ? pinLevels(port) : 0;
+		case REG_LAT:
+			return (op == OP_WRITE) ? sim_ports[port].lat : 0;
+		default:
+			return (op == OP_WRITE) ? sim_ports[port].tris : 0;
+	}
+}
+
+SimReg& SimReg::operator=(unsigned int value)
+{
+	unsigned int current = (reg == REG_TRIS) ? sim_ports[port].tris : sim_ports[port].lat;
+
+	switch (op) {
+		case OP_SET: value = current | value; break;
+		case OP_CLR: value = current & ~value; break;
+		case OP_INV: value = current ^ value; break;
+	}
+
+	if (reg == REG_TRIS) {
+		writeTris(port, value);
+	} else {
+		sim_portWrites++;
+		writeLat(port, value);
+	}
+	return *this;
+}
+
+#define SIM_DEFINE_REG(name, port, reg) \
+	SimReg name(port, reg, OP_WRITE); \
+	SimReg name##SET(port, reg, OP_SET); \
+	SimReg name##CLR(port, reg, OP_CLR); \
+	SimReg name##INV(port, reg, OP_INV);
+
+#define SIM_DEFINE_PORT(x) \
+	SIM_DEFINE_REG(PORT##x, SIM_PORT##x, REG_PORT) \
+	SIM_DEFINE_REG(LAT##x, SIM_PORT##x, REG_LAT) \
+	SIM_DEFINE_REG(TRIS##x, SIM_PORT##x, REG_TRIS)
+
+SIM_DEFINE_PORT(A)
+SIM_DEFINE_PORT(B)
+SIM_DEFINE_PORT(C)
+SIM_DEFINE_PORT(D)
+SIM_DEFINE_PORT(E)
+SIM_DEFINE_PORT(F)
+SIM_DEFINE_PORT(G)
+
+
+/******************************************************************************
+ Interrupts
+******************************************************************************/
+
+static void callHandler(int vector)
+{
+	switch (vector) {
+		case SIM_VECTOR_OC4:
+			if (IntOC4Handler) IntOC4Handler();
+			break;
+		case SIM_VECTOR_OC5:
+			if (IntOC5Handler) IntOC5Handler();
+			break;
+		case SIM_VECTOR_DMA0:
+			if (IntDMA0Handler) IntDMA0Handler();
+			break;
+		case SIM_VECTOR_DMA1:
+			if (IntDMA1Handler) IntDMA1Handler();
+			break;
+		case SIM_VECTOR_DMA2:
+			if (IntDMA2Handler) IntDMA2Handler();
+			break;
+		case SIM_VECTOR_DMA3:
+			if (IntDMA3Handler) IntDMA3Handler();
+			break;
+	}
+}
+
+/** Run pending handlers, lowest vector first. Handlers never nest. */
+static void dispatch(void)
+{
+	if (sim_inIsr) return;
+
+	for (int v = 0; v < SIM_NUM_VECTORS; v++) {
+		if (!sim_pending[v]) continue;
+
+		sim_pending[v] = 0;
+		sim_inIsr = 1;
+		callHandler(v);
+		sim_isrCount[v]++;
+		sim_inIsr = 0;
+
+		// A handler may have raised another interrupt
+		v = -1;
+	}
+}
+
+
+/******************************************************************************
+ Event scheduling
+******************************************************************************/
+
+/** First time after 'after' at which the timer counter equals 'tick' */
+static uint64_t nextTick(const SimTimer& t, unsigned int tick, uint64_t after)
+{
+	if (!t.on || tick > t.period) return NEVER;
+
+	uint64_t periodCycles = (uint64_t)t.prescale * (t.period + 1);
+	uint64_t first = t.start + (uint64_t)tick * t.prescale;
+
+	if (after < first) return first;
+	return first + ((after - first) / periodCycles + 1) * periodCycles;
+}
+
+static uint64_t nextOCEdge(const SimOC& oc, uint64_t after)
+{
+	if (!oc.on || oc.r == oc.rs) return NEVER;
+
+	const SimTimer& t = (oc.timer == 2) ? sim_timer2 : sim_timer3;
+	uint64_t rise = nextTick(t, oc.r, after);
+	uint64_t fall = nextTick(t, oc.rs, after);
+
+	return (rise < fall) ? rise : fall;
+}
+
+static uint64_t nextEvent(void)
+{
+	uint64_t t = NEVER;
+
+	for (int c = 1; c <= 2; c++) {
+		if (sim_spi[c].shiftValid && sim_spi[c].shiftEnd < t) t = sim_spi[c].shiftEnd;
+	}
+
+	uint64_t oc4 = nextOCEdge(sim_oc4, sim_now);
+	uint64_t oc5 = nextOCEdge(sim_oc5, sim_now);
+	if (oc4 < t) t = oc4;
+	if (oc5 < t) t = oc5;
+
+	return t;
+}
+
+static void startShift(SimSpi& spi)
+{
+	spi.shiftWord = spi.txWord;
+	spi.shiftValid = 1;
+	spi.shiftEnd = sim_now + spi.wordCycles;
+	spi.txValid = 0;
+}
+
+/** Put the bits of a finished word on SDO/SCK, MSB first */
+static void emitWord(SimSpi& spi)
+{
+	for (int s = spi.bits - 1; s >= 0; s--) {
+		drivePin(spi.sdoPort, spi.sdoPin, (spi.shiftWord >> s) & 0x1);
+		drivePin(spi.sckPort, spi.sckPin, 1);
+		drivePin(spi.sckPort, spi.sckPin, 0);
+	}
+	spi.words++;
+}
+
+/** Move cells into every SPI transmit buffer that a DMA channel is waiting on */
+static void serviceDma(void)
+{
+	for (int c = 0; c < SIM_NUM_DMA; c++) {
+		SimDma& dma = sim_dma[c];
+		if (!dma.enabled) continue;
+
+		int channel = (dma.irq == SIM_IRQ_SPI1_TX) ? 1 : ((dma.irq == SIM_IRQ_SPI2_TX) ? 2 : 0);
+		if (!channel) continue;
+
+		SimSpi& spi = sim_spi[channel];
+		while (spi.on && !spi.txValid && (dma.offset < dma.srcSize)) {
+			unsigned int word = 0;
+			for (int b = 0; b < dma.cellSize; b++) {
+				word |= (unsigned int)dma.src[dma.offset + b] << (8 * b);
+			}
+			dma.offset += dma.cellSize;
+
+			spi.txWord = word;
+			spi.txValid = 1;
+			if (!spi.shiftValid) startShift(spi);
+		}
+
+		if (dma.offset >= dma.srcSize) {
+			dma.enabled = 0;
+			dma.evFlags |= DMA_EV_BLOCK_DONE;
+			if (dma.intOn && (dma.evEnable & DMA_EV_BLOCK_DONE)) {
+				sim_pending[SIM_VECTOR_DMA0 + c] = 1;
+			}
+		}
+	}
+}
+
+static void runOC(SimOC& oc, uint64_t t)
+{
+	if (!oc.on || oc.r == oc.rs) return;
+
+	const SimTimer& timer = (oc.timer == 2) ? sim_timer2 : sim_timer3;
+
+	if (nextTick(timer, oc.r, t - 1) == t) {
+		drivePin(oc.port, oc.pin, 1);
+	}
+	if (nextTick(timer, oc.rs, t - 1) == t) {
+		drivePin(oc.port, oc.pin, 0);
+		if (oc.intOn) sim_pending[oc.vector] = 1;
+	}
+}
+
+static void runEventsAt(uint64_t t)
+{
+	sim_now = t;
+
+	for (int c = 1; c <= 2; c++) {
+		SimSpi& spi = sim_spi[c];
+		if (spi.shiftValid && spi.shiftEnd == t) {
+			emitWord(spi);
+			spi.shiftValid = 0;
+			if (spi.txValid) startShift(spi);
+		}
+	}
+	serviceDma();
+
+	runOC(sim_oc4, t);
+	runOC(sim_oc5, t);
+
+	dispatch();
+}
+
+static void advanceTo(uint64_t target)
+{
+	uint64_t t;
+	while ((t = nextEvent()) <= target) {
+		runEventsAt(t);
+	}
+	if (target > sim_now) sim_now = target;
+}
+
+
+/******************************************************************************
+ Control API
+******************************************************************************/
+
+uint64_t SimCycles(void)
+{
+	return sim_now;
+}
+
+void SimAdvance(uint64_t cycles)
+{
+	advanceTo(sim_now + cycles);
+}
+
+void SimIdle(void)
+{
+	uint64_t t = nextEvent();
+
+	if (t == NEVER) {
+		sim_now++;
+	} else {
+		advanceTo(t);
+	}
+}
+
+int SimAttach(SimPinListener* listener)
+{
+	if (sim_numListeners == SIM_MAX_LISTENERS) return 0;
+
+	sim_listeners[sim_numListeners++] = listener;
+	return 1;
+}
+
+unsigned int SimPins(int port)
+{
+	return pinLevels(port);
+}
+
+unsigned int SimTris(int port)
+{
+	return sim_ports[port].tris;
+}
+
+uint64_t SimGSCLKCount(void)
+{
+	if (!sim_oc1.on || !sim_timer2.on) return 0;
+
+	uint64_t periodCycles = (uint64_t)sim_timer2.prescale * (sim_timer2.period + 1);
+	return (sim_now - sim_oc1.start) / periodCycles;
+}
+
+unsigned long SimIsrCount(int vector)
+{
+	return sim_isrCount[vector];
+}
+
+unsigned long SimSpiWords(int channel)
+{
+	return sim_spi[channel].words;
+}
+
+unsigned long SimPortWrites(void)
+{
+	return sim_portWrites;
+}
+
+
+/******************************************************************************
+ plib: SPI
+******************************************************************************/
+
+static void openSPI(SimSpi& spi, unsigned int config1, unsigned int config2)
+{
+	static const unsigned int primary[4] = {64, 16, 4, 1};
+	unsigned int secondary = 8 - ((config1 >> 2) & 0x7);
+
+	spi.on = (config2 & SPI_ENABLE) != 0;
+	spi.bits = (config1 & SPI_MODE32_ON) ? 32 : ((config1 & SPI_MODE16_ON) ? 16 : 8);
+	spi.wordCycles = (uint64_t)spi.bits * primary[config1 & 0x3] * secondary;
+	spi.txValid = 0;
+	spi.shiftValid = 0;
+
+	claimPin(spi.sdoPort, spi.sdoPin, spi.on);
+	claimPin(spi.sckPort, spi.sckPin, spi.on);
+}
+
+static void putcSPI(SimSpi& spi, unsigned int data)
+{
+	if (!spi.on) return;
+
+	// Block while the transmit buffer is full, as plib does
+	while (spi.txValid) SimIdle();
+
+	spi.txWord = data;
+	spi.txValid = 1;
+	if (!spi.shiftValid) startShift(spi);
+}
+
+void OpenSPI1(unsigned int config1, unsigned int config2)
+{
+	openSPI(sim_spi[1], config1, config2);
+}
+
+void OpenSPI2(unsigned int config1, unsigned int config2)
+{
+	openSPI(sim_spi[2], config1, config2);
+}
+
+void putcSPI1(unsigned int data)
+{
+	putcSPI(sim_spi[1], data);
+}
+
+void putcSPI2(unsigned int data)
+{
+	putcSPI(sim_spi[2], data);
+}
+
+void putsSPI1(unsigned int length, unsigned int* data)
+{
+	while (length--) putcSPI(sim_spi[1], *data++);
+}
+
+void putsSPI2(unsigned int length, unsigned int* data)
+{
+	while (length--) putcSPI(sim_spi[2], *data++);
+}
+
+int SpiChnIsBusy(SpiChannel chn)
+{
+	SimSpi& spi = sim_spi[chn];
+	int busy = spi.shiftValid || spi.txValid;
+
+	// Polling takes time on the real part as well
+	if (busy) SimIdle();
+
+	return busy;
+}
+
+
+/******************************************************************************
+ plib: Timers and output compare
+******************************************************************************/
+
+static void openTimer(SimTimer& t, unsigned int config, unsigned int period)
+{
+	static const unsigned int prescale[8] = {1, 2, 4, 8, 16, 32, 64, 256};
+
+	t.on = (config & T2_ON) != 0;
+	t.prescale = prescale[(config >> 4) & 0x7];
+	t.period = period & 0xFFFF;
+	t.start = sim_now;
+}
+
+void OpenTimer2(unsigned int config, unsigned int period)
+{
+	openTimer(sim_timer2, config, period);
+}
+
+void OpenTimer3(unsigned int config, unsigned int period)
+{
+	openTimer(sim_timer3, config, period);
+}
+
+static void openOC(SimOC& oc, unsigned int config, unsigned int value1, unsigned int value2)
+{
+	oc.on = (config & OC_ON) != 0;
+	oc.timer = (config & OC_TIMER3_SRC) ? 3 : 2;
+	oc.rs = value1;
+	oc.r = value2;
+	oc.start = sim_now;
+
+	claimPin(oc.port, oc.pin, oc.on);
+	drivePin(oc.port, oc.pin, 0);
+}
+
+void OpenOC1(unsigned int config, unsigned int value1, unsigned int value2)
+{
+	openOC(sim_oc1, config, value1, value2);
+}
+
+void OpenOC4(unsigned int config, unsigned int value1, unsigned int value2)
+{
+	openOC(sim_oc4, config, value1, value2);
+}
+
+void OpenOC5(unsigned int config, unsigned int value1, unsigned int value2)
+{
+	openOC(sim_oc5, config, value1, value2);
+}
+
+void SetPulseOC4(unsigned int start, unsigned int stop)
+{
+	sim_oc4.r = start;
+	sim_oc4.rs = stop;
+}
+
+void SetPulseOC5(unsigned int start, unsigned int stop)
+{
+	sim_oc5.r = start;
+	sim_oc5.rs = stop;
+}
+
+void ConfigIntOC4(unsigned int config)
+{
+	sim_oc4.intOn = (config & OC_INT_ON) != 0;
+}
+
+void ConfigIntOC5(unsigned int config)
+{
+	sim_oc5.intOn = (config & OC_INT_ON) != 0;
+}
+
+
+/******************************************************************************
+ plib: DMA
+******************************************************************************/
+
+void DmaChnOpen(DmaChannel chn, DmaChannelPri chPri, unsigned int oFlags)
+{
+	SimDma& dma = sim_dma[chn];
+
+	dma.enabled = 0;
+	dma.irq = SIM_IRQ_NONE;
+	dma.evFlags = 0;
+}
+
+void DmaChnSetEventControl(DmaChannel chn, unsigned int dmaEvCtrl)
+{
+	sim_dma[chn].irq = (dmaEvCtrl & DMA_EV_START_IRQ_EN) ? (int)(dmaEvCtrl >> 8) : SIM_IRQ_NONE;
+}
+
+void DmaChnSetTxfer(DmaChannel chn, const void* vSrcAdd, void* vDstAdd, int srcSize, int dstSize, int cellSize)
+{
+	SimDma& dma = sim_dma[chn];
+
+	dma.src = (const unsigned char*)vSrcAdd;
+	dma.dst = vDstAdd;
+	dma.srcSize = srcSize;
+	dma.cellSize = cellSize;
+	dma.offset = 0;
+}
+
+void DmaChnSetEvEnableFlags(DmaChannel chn, unsigned int eFlags)
+{
+	sim_dma[chn].evEnable |= eFlags;
+}
+
+void DmaChnSetIntPriority(DmaChannel chn, int iPri, int subPri)
+{
+}
+
+void DmaChnIntEnable(DmaChannel chn)
+{
+	sim_dma[chn].intOn = 1;
+}
+
+void DmaChnIntDisable(DmaChannel chn)
+{
+	sim_dma[chn].intOn = 0;
+}
+
+void DmaChnStartTxfer(DmaChannel chn, int wait, unsigned long retries)
+{
+	sim_dma[chn].enabled = 1;
+	serviceDma();
+	dispatch();
+}
+
+void DmaChnDisable(DmaChannel chn)
+{
+	sim_dma[chn].enabled = 0;
+}
+
+unsigned int DmaChnGetEvFlags(DmaChannel chn)
+{
+	return sim_dma[chn].evFlags;
+}
+
+void DmaChnClrEvFlags(DmaChannel chn, unsigned int eFlags)
+{
+	sim_dma[chn].evFlags &= ~eFlags;
+}
+
+void DmaChnClrIntFlag(DmaChannel chn)
+{
+	sim_pending[SIM_VECTOR_DMA0 + chn] = 0;
+}
@@ -0,0 +1,119 @@
+/******************************************************************************
+Control API for the host-side PIC32 simulator.
+
+	A host program includes the library it wants to exercise (Tlc5940.h or
+LEDCube.h) together with this header, and builds the library sources with
+the HostSim directory on the include path so that <plib.h> resolves to the
+simulated peripherals:
+
+	g++ -IHostSim -ITlc5940 sketch.cpp Tlc5940/Tlc5940.cpp HostSim/HostSim.cpp
+
+	Simulated time only advances while the library waits on hardware or when
+the program calls SimAdvance(). Interrupts are dispatched one at a time
+between events, never in the middle of main-line code, so every run is
+repeatable down to the cycle.
+******************************************************************************/
+
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+#include <stdint.h>
+
+/** Simulated core and peripheral bus clock (chipKIT Uno32/Max32) */
+#define SIM_CPU_HZ		80000000UL
+
+#define SIM_MAX_LISTENERS	16
+
+/** Ports as passed to SimPinListener */
+enum SimPortId {
+	SIM_PORTA,
+	SIM_PORTB,
+	SIM_PORTC,
+	SIM_PORTD,
+	SIM_PORTE,
+	SIM_PORTF,
+	SIM_PORTG,
+	SIM_NUM_PORTS
+};
+
+/** Interrupt vectors known to the simulator */
+enum SimVector {
+	SIM_VECTOR_OC1,
+	SIM_VECTOR_OC4,
+	SIM_VECTOR_OC5,
+	SIM_VECTOR_DMA0,
+	SIM_VECTOR_DMA1,
+	SIM_VECTOR_DMA2,
+	SIM_VECTOR_DMA3,
+	SIM_NUM_VECTORS
+};
+
+/** Interrupt requests that can start a DMA cell transfer */
+enum SimIrq {
+	SIM_IRQ_NONE,
+	SIM_IRQ_SPI1_TX,
+	SIM_IRQ_SPI2_TX
+};
+
+#define SIM_NUM_DMA		4
+
+/** Output compare pins as wired on the PIC32MX3xx/4xx parts */
+#define SIM_OC1_PORT	SIM_PORTD
+#define SIM_OC1_PIN		0x01
+#define SIM_OC4_PORT	SIM_PORTD
+#define SIM_OC4_PIN		0x08
+#define SIM_OC5_PORT	SIM_PORTD
+#define SIM_OC5_PIN		0x10
+
+/** SPI1 pins (SDO1 = RF8, SCK1 = RF6) and SPI2 pins (SDO2 = RG8, SCK2 = RG6) */
+#define SIM_SDO1_PORT	SIM_PORTF
+#define SIM_SDO1_PIN	0x100
+#define SIM_SCK1_PORT	SIM_PORTF
+#define SIM_SCK1_PIN	0x40
+
+#define SIM_SDO2_PORT	SIM_PORTG
+#define SIM_SDO2_PIN	0x100
+#define SIM_SCK2_PORT	SIM_PORTG
+#define SIM_SCK2_PIN	0x40
+
+/** Receives every change of pin level, whether it comes from a register
+    write or from a peripheral driving its pin. */
+class SimPinListener
+{
+  public:
+	virtual ~SimPinListener() {}
+	virtual void pinsChanged(int port, unsigned int before, unsigned int after) = 0;
+	virtual void trisChanged(int port, unsigned int before, unsigned int after) {}
+};
+
+/** Current simulated time in CPU cycles */
+uint64_t SimCycles(void);
+
+/** Let the given number of cycles pass, firing any events that fall due */
+void SimAdvance(uint64_t cycles);
+
+/** Jump to the next scheduled peripheral event (used by busy-wait loops) */
+void SimIdle(void);
+
+/** Register a listener for pin changes. Returns 0 if the table is full. */
+int SimAttach(SimPinListener* listener);
+
+/** Current pin levels and direction of a port */
+unsigned int SimPins(int port);
+unsigned int SimTris(int port);
+
+/** Number of GSCLK pulses produced by OC1 since it was started */
+uint64_t SimGSCLKCount(void);
+
+/** Number of times the handler for a vector has run */
+unsigned long SimIsrCount(int vector);
+
+/** Number of 32-bit words shifted out of an SPI channel (1 or 2) */
+unsigned long SimSpiWords(int channel);
+
+/** Number of writes to the PORTx/LATx registers (SET/CLR/INV included) so far.
+    Register writes take no simulated time, so this is the way to compare the
+    cost of bit-banged transfers: multiply by the cycles one write takes. */
+unsigned long SimPortWrites(void);
+
+#endif
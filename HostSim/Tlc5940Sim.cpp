@@ -0,0 +1,178 @@
+/******************************************************************************
+Software model of a daisy chain of TLC5940s. See Tlc5940Sim.h.
+******************************************************************************/
+
+#include "Tlc5940Sim.h"
+
+const Tlc5940SimPins TLC5940SIM_TLC_PINS = {
+	SIM_SDO2_PORT, SIM_SDO2_PIN,
+	SIM_SCK2_PORT, SIM_SCK2_PIN,
+	SIM_OC4_PORT, SIM_OC4_PIN,
+	SIM_OC5_PORT, SIM_OC5_PIN,
+	SIM_PORTF, 0x2
+};
+
+const Tlc5940SimPins TLC5940SIM_CUBE_PINS = {
+	SIM_SDO2_PORT, SIM_SDO2_PIN,
+	SIM_SCK2_PORT, SIM_SCK2_PIN,
+	SIM_OC4_PORT, SIM_OC4_PIN,
+	SIM_OC5_PORT, SIM_OC5_PIN,
+	SIM_PORTD, 0x40
+};
+
+Tlc5940Sim::Tlc5940Sim(int numTLCs, const Tlc5940SimPins& pins)
+	: numTLCs(numTLCs),
+	  pins(pins),
+	  gsShift(numTLCs * 192, 0),
+	  dcShift(numTLCs * 96, 0),
+	  gsHead(0),
+	  dcHead(0),
+	  gsData(numTLCs * 16, 0),
+	  dcData(numTLCs * 16, 63),
+	  sin(0),
+	  vprg(0),
+	  blank(1),
+	  swallowSCLK(0),
+	  gsclkAtBlank(0),
+	  numGSLatches(0),
+	  numDCLatches(0),
+	  numFullCycles(0),
+	  numShortCycles(0),
+	  latchCycle(0)
+{
+	sin = (SimPins(pins.sinPort) & pins.sinPin) != 0;
+	vprg = (SimPins(pins.vprgPort) & pins.vprgPin) != 0;
+	SimAttach(this);
+}
+
+/** Bit 'position' of a shift register, counted from the end nearest SIN */
+int Tlc5940Sim::shiftBit(const std::vector<uint8_t>& reg, int head, int position) const
+{
+	return reg[(head + position) % reg.size()];
+}
+
+void Tlc5940Sim::pinsChanged(int port, unsigned int before, unsigned int after)
+{
+	unsigned int rising = ~before & after;
+	unsigned int falling = before & ~after;
+
+	if (port == pins.sinPort) {
+		sin = (after & pins.sinPin) != 0;
+	}
+
+	if (port == pins.vprgPort) {
+		vprg = (after & pins.vprgPin) != 0;
+	}
+
+	if ((port == pins.sclkPort) && (rising & pins.sclkPin)) {
+		clock();
+	}
+
+	if ((port == pins.blankPort) && (rising & pins.blankPin)) {
+		blankRising();
+	}
+
+	if ((port == pins.xlatPort) && (rising & pins.xlatPin)) {
+		latch();
+	}
+
+	if ((port == pins.blankPort) && (falling & pins.blankPin)) {
+		blankFalling();
+	}
+}
+
+void Tlc5940Sim::clock(void)
+{
+	if (vprg) {
+		dcHead = (dcHead + dcShift.size() - 1) % dcShift.size();
+		dcShift[dcHead] = sin;
+		return;
+	}
+
+	// The first SCLK of a GS cycle that follows a DC latch is lost
+	if (swallowSCLK) {
+		swallowSCLK = 0;
+		return;
+	}
+
+	gsHead = (gsHead + gsShift.size() - 1) % gsShift.size();
+	gsShift[gsHead] = sin;
+}
+
+void Tlc5940Sim::latch(void)
+{
+	latchCycle = SimCycles();
+
+	if (vprg) {
+		for (int ch = 0; ch < numTLCs * 16; ch++) {
+			int base = (ch / 16) * 96 + (ch % 16) * 6;
+			int value = 0;
+			for (int b = 5; b >= 0; b--) {
+				value = (value << 1) | shiftBit(dcShift, dcHead, base + b);
+			}
+			dcData[ch] = value;
+		}
+		swallowSCLK = 1;
+		numDCLatches++;
+	} else {
+		for (int ch = 0; ch < numTLCs * 16; ch++) {
+			int base = (ch / 16) * 192 + (ch % 16) * 12;
+			int value = 0;
+			for (int b = 11; b >= 0; b--) {
+				value = (value << 1) | shiftBit(gsShift, gsHead, base + b);
+			}
+			gsData[ch] = value;
+		}
+		numGSLatches++;
+	}
+
+	latched(vprg);
+}
+
+void Tlc5940Sim::blankRising(void)
+{
+	if (!blank) {
+		if (SimGSCLKCount() - gsclkAtBlank >= 4096) {
+			numFullCycles++;
+		} else {
+			numShortCycles++;
+		}
+	}
+	blank = 1;
+}
+
+void Tlc5940Sim::blankFalling(void)
+{
+	blank = 0;
+	gsclkAtBlank = SimGSCLKCount();
+}
+
+int Tlc5940Sim::gs(int channel) const
+{
+	return gsData[channel];
+}
+
+int Tlc5940Sim::dc(int channel) const
+{
+	return dcData[channel];
+}
+
+double Tlc5940Sim::duty(int channel) const
+{
+	return (gsData[channel] / 4096.0) * (dcData[channel] / 63.0);
+}
+
+int Tlc5940Sim::gsCounter(void) const
+{
+	if (blank) return 0;
+
+	uint64_t count = SimGSCLKCount() - gsclkAtBlank;
+	return (count > 4096) ? 4096 : (int)count;
+}
+
+int Tlc5940Sim::output(int channel) const
+{
+	if (blank) return 0;
+
+	return gsCounter() < gsData[channel];
+}
@@ -0,0 +1,113 @@
+/******************************************************************************
+Software model of a daisy chain of TLC5940s for the host simulator.
+
+	The model listens to the simulated SIN/SCLK/XLAT/BLANK/VPRG pins, exactly
+as the chips would:
+	- a 192-bit grayscale and a 96-bit dot correction shift register per
+	  device, chained SOUT to SIN, clocked on the rising edge of SCLK into the
+	  register selected by VPRG
+	- XLAT latches the shift register into the GS or DC register
+	- BLANK resets the 4096-step GS counter, which then counts GSCLK pulses
+	- the first SCLK after a dot correction latch is swallowed, as described
+	  in the data sheet, unless an extra pulse is given
+
+	Channel numbers follow the library: OUT0 of the first TLC (the one wired
+to the chipKIT) is channel 0, OUT0 of the next TLC is channel 16, etc.
+******************************************************************************/
+
+#ifndef TLC5940SIM_H
+#define TLC5940SIM_H
+
+#include <stdint.h>
+#include <vector>
+#include "HostSim.h"
+
+/** Where the chain is wired. GSCLK always comes from OC1. */
+struct Tlc5940SimPins {
+	int sinPort;
+	unsigned int sinPin;
+	int sclkPort;
+	unsigned int sclkPin;
+	int xlatPort;
+	unsigned int xlatPin;
+	int blankPort;
+	unsigned int blankPin;
+	int vprgPort;
+	unsigned int vprgPin;
+};
+
+/** Wiring used by the Tlc5940 library (VPRG on RF1) */
+extern const Tlc5940SimPins TLC5940SIM_TLC_PINS;
+
+/** Wiring used by the LEDCube library (VPRG on RD6) */
+extern const Tlc5940SimPins TLC5940SIM_CUBE_PINS;
+
+class Tlc5940Sim : public SimPinListener
+{
+  public:
+	Tlc5940Sim(int numTLCs, const Tlc5940SimPins& pins);
+
+	/** Latched grayscale (0-4095) and dot correction (0-63) of a channel */
+	int gs(int channel) const;
+	int dc(int channel) const;
+
+	/** Fraction of full current a channel averages over a GS cycle */
+	double duty(int channel) const;
+
+	/** Whether a channel's output is sinking current right now */
+	int output(int channel) const;
+
+	/** Position of the GS counter (4096 once the cycle has finished) */
+	int gsCounter(void) const;
+
+	/** Number of grayscale and dot correction latches so far */
+	unsigned long gsLatches(void) const { return numGSLatches; }
+	unsigned long dcLatches(void) const { return numDCLatches; }
+
+	/** Simulated time of the most recent XLAT */
+	uint64_t lastLatchCycle(void) const { return latchCycle; }
+
+	/** GS cycles that reached all 4096 steps, and those cut short by BLANK */
+	unsigned long pwmCycles(void) const { return numFullCycles; }
+	unsigned long truncatedCycles(void) const { return numShortCycles; }
+
+	int numChannels(void) const { return numTLCs * 16; }
+
+	virtual void pinsChanged(int port, unsigned int before, unsigned int after);
+
+  protected:
+	/** Called after every XLAT; vprg is set for a dot correction latch */
+	virtual void latched(int vprg) {}
+
+  private:
+	void clock(void);
+	void latch(void);
+	void blankRising(void);
+	void blankFalling(void);
+	int shiftBit(const std::vector<uint8_t>& reg, int head, int position) const;
+
+	int numTLCs;
+	Tlc5940SimPins pins;
+
+	std::vector<uint8_t> gsShift;
+	std::vector<uint8_t> dcShift;
+	int gsHead;
+	int dcHead;
+
+	std::vector<uint16_t> gsData;
+	std::vector<uint8_t> dcData;
+
+	int sin;
+	int vprg;
+	int blank;
+	int swallowSCLK;
+
+	uint64_t gsclkAtBlank;
+	unsigned long numGSLatches;
+	unsigned long numDCLatches;
+	unsigned long numFullCycles;
+	unsigned long numShortCycles;
+	uint64_t latchCycle;
+};
+
+#endif
@@ -0,0 +1,208 @@
+/******************************************************************************
+Host-side stand-in for Microchip's PIC32 peripheral library (plib.h).
+
+	Compiling the Tlc5940 or LEDCube library with this directory on the
+include path (ahead of the real compiler's headers) swaps every plib call for
+a simulated peripheral: SPI1/2, DMA, Timer2/3, OC1/4/5 and the GPIO ports. Time is a
+cycle counter running at SIM_CPU_HZ which only moves forward when the
+library waits on hardware (SpiChnIsBusy, putsSPI2, the busy_wait() hook) or
+when the host program calls SimAdvance(). Interrupt handlers defined by the
+library (IntOC4Handler, IntOC5Handler, IntDMA0Handler...) are called at the simulated time the
+matching output compare event would fire.
+
+	Only the subset of plib the libraries actually use is provided. See
+HostSim.h for the simulator control API.
+******************************************************************************/
+
+#ifndef HOSTSIM_PLIB_H
+#define HOSTSIM_PLIB_H
+
+#include <stdint.h>
+#include "HostSim.h"
+
+/** ISR decoration. Handlers are plain functions on the host. */
+#define __ISR(vector, ipl)
+
+#define _OUTPUT_COMPARE_1_VECTOR	SIM_VECTOR_OC1
+#define _OUTPUT_COMPARE_4_VECTOR	SIM_VECTOR_OC4
+#define _OUTPUT_COMPARE_5_VECTOR	SIM_VECTOR_OC5
+#define _DMA_0_VECTOR				SIM_VECTOR_DMA0
+#define _DMA_1_VECTOR				SIM_VECTOR_DMA1
+#define _DMA_2_VECTOR				SIM_VECTOR_DMA2
+#define _DMA_3_VECTOR				SIM_VECTOR_DMA3
+
+/** Advance simulated time from inside the library's busy-wait loops */
+#define busy_wait()		SimIdle()
+
+
+/** GPIO registers. Each one is an object so that writes can be traced. */
+class SimReg
+{
+  public:
+	SimReg(int port, int reg, int op) : port(port), reg(reg), op(op) {}
+
+	operator unsigned int() const;
+	SimReg& operator=(unsigned int value);
+	SimReg& operator=(const SimReg& other) { return *this = (unsigned int)other; }
+	SimReg& operator|=(unsigned int value) { return *this = ((unsigned int)*this | value); }
+	SimReg& operator&=(unsigned int value) { return *this = ((unsigned int)*this & value); }
+	SimReg& operator^=(unsigned int value) { return *this = ((unsigned int)*this ^ value); }
+
+  private:
+	int port;
+	int reg;
+	int op;
+};
+
+#define SIM_DECLARE_REG(name) \
+	extern SimReg name, name##SET, name##CLR, name##INV;
+
+#define SIM_DECLARE_PORT(x) \
+	SIM_DECLARE_REG(PORT##x) \
+	SIM_DECLARE_REG(LAT##x) \
+	SIM_DECLARE_REG(TRIS##x)
+
+SIM_DECLARE_PORT(A)
+SIM_DECLARE_PORT(B)
+SIM_DECLARE_PORT(C)
+SIM_DECLARE_PORT(D)
+SIM_DECLARE_PORT(E)
+SIM_DECLARE_PORT(F)
+SIM_DECLARE_PORT(G)
+
+
+/** SPI */
+typedef enum {
+	SPI_CHANNEL1 = 1,
+	SPI_CHANNEL2 = 2
+} SpiChannel;
+
+// Bits 0-1: primary prescaler, bits 2-4: secondary prescaler (PIC24-style)
+#define PRI_PRESCAL_64_1	0x00
+#define PRI_PRESCAL_16_1	0x01
+#define PRI_PRESCAL_4_1		0x02
+#define PRI_PRESCAL_1_1		0x03
+#define SEC_PRESCAL_8_1		(0 << 2)
+#define SEC_PRESCAL_7_1		(1 << 2)
+#define SEC_PRESCAL_6_1		(2 << 2)
+#define SEC_PRESCAL_5_1		(3 << 2)
+#define SEC_PRESCAL_4_1		(4 << 2)
+#define SEC_PRESCAL_3_1		(5 << 2)
+#define SEC_PRESCAL_2_1		(6 << 2)
+#define SEC_PRESCAL_1_1		(7 << 2)
+
+#define SPI_MODE32_ON		0x0400
+#define SPI_MODE16_ON		0x0200
+#define MASTER_ENABLE_ON	0x0020
+#define SPI_CKE_ON			0x0100
+#define FRAME_ENABLE_OFF	0x0000
+#define SPI_ENABLE			0x8000
+
+void OpenSPI1(unsigned int config1, unsigned int config2);
+void OpenSPI2(unsigned int config1, unsigned int config2);
+
+/** Transmit buffers. Only their addresses matter, as DMA destinations. */
+extern volatile unsigned int SPI1BUF;
+extern volatile unsigned int SPI2BUF;
+
+void putcSPI1(unsigned int data);
+void putcSPI2(unsigned int data);
+void putsSPI1(unsigned int length, unsigned int* data);
+void putsSPI2(unsigned int length, unsigned int* data);
+int SpiChnIsBusy(SpiChannel chn);
+
+
+/** Timers */
+#define T2_ON			0x8000
+#define T2_OFF			0x0000
+#define T2_PS_1_1		(0 << 4)
+#define T2_PS_1_2		(1 << 4)
+#define T2_PS_1_4		(2 << 4)
+#define T2_PS_1_8		(3 << 4)
+#define T2_PS_1_16		(4 << 4)
+#define T2_PS_1_32		(5 << 4)
+#define T2_PS_1_64		(6 << 4)
+#define T2_PS_1_256		(7 << 4)
+
+#define T3_ON			T2_ON
+#define T3_OFF			T2_OFF
+#define T3_PS_1_1		T2_PS_1_1
+#define T3_PS_1_2		T2_PS_1_2
+#define T3_PS_1_4		T2_PS_1_4
+#define T3_PS_1_8		T2_PS_1_8
+#define T3_PS_1_16		T2_PS_1_16
+#define T3_PS_1_32		T2_PS_1_32
+#define T3_PS_1_64		T2_PS_1_64
+#define T3_PS_1_256		T2_PS_1_256
+
+void OpenTimer2(unsigned int config, unsigned int period);
+void OpenTimer3(unsigned int config, unsigned int period);
+
+
+/** Output compare. As in plib, value1 is OCxRS and value2 is OCxR. */
+#define OC_ON						0x8000
+#define OC_OFF						0x0000
+#define OC_TIMER2_SRC				0x0000
+#define OC_TIMER3_SRC				0x0008
+#define OC_CONTINUE_PULSE			0x0005
+#define OC_PWM_FAULT_PIN_DISABLE	0x0006
+
+#define OC_INT_ON			0x0008
+#define OC_INT_OFF			0x0000
+#define OC_INT_PRIOR_3		0x0003
+#define OC_INT_SUB_PRI_3	0x0030
+
+void OpenOC1(unsigned int config, unsigned int value1, unsigned int value2);
+void OpenOC4(unsigned int config, unsigned int value1, unsigned int value2);
+void OpenOC5(unsigned int config, unsigned int value1, unsigned int value2);
+void SetPulseOC4(unsigned int start, unsigned int stop);
+void SetPulseOC5(unsigned int start, unsigned int stop);
+void ConfigIntOC4(unsigned int config);
+void ConfigIntOC5(unsigned int config);
+
+#define mOC4ClearIntFlag()	((void)0)
+#define mOC5ClearIntFlag()	((void)0)
+
+
+/** DMA. Only SPI transmit interrupts are supported as start events. */
+typedef enum {
+	DMA_CHANNEL0,
+	DMA_CHANNEL1,
+	DMA_CHANNEL2,
+	DMA_CHANNEL3
+} DmaChannel;
+
+typedef enum {
+	DMA_CHN_PRI0,
+	DMA_CHN_PRI1,
+	DMA_CHN_PRI2,
+	DMA_CHN_PRI3
+} DmaChannelPri;
+
+#define DMA_OPEN_DEFAULT		0x0000
+
+#define _SPI1_TX_IRQ			SIM_IRQ_SPI1_TX
+#define _SPI2_TX_IRQ			SIM_IRQ_SPI2_TX
+
+#define DMA_EV_START_IRQ_EN		0x0010
+#define DMA_EV_START_IRQ(irq)	((irq) << 8)
+
+#define DMA_EV_BLOCK_DONE		0x0008
+#define DMA_EV_ALL_EVNTS		0x00FF
+
+#define DMA_WAIT_NOT			0
+
+void DmaChnOpen(DmaChannel chn, DmaChannelPri chPri, unsigned int oFlags);
+void DmaChnSetEventControl(DmaChannel chn, unsigned int dmaEvCtrl);
+void DmaChnSetTxfer(DmaChannel chn, const void* vSrcAdd, void* vDstAdd, int srcSize, int dstSize, int cellSize);
+void DmaChnSetEvEnableFlags(DmaChannel chn, unsigned int eFlags);
+void DmaChnSetIntPriority(DmaChannel chn, int iPri, int subPri);
+void DmaChnIntEnable(DmaChannel chn);
+void DmaChnIntDisable(DmaChannel chn);
+void DmaChnStartTxfer(DmaChannel chn, int wait, unsigned long retries);
+void DmaChnDisable(DmaChannel chn);
+unsigned int DmaChnGetEvFlags(DmaChannel chn);
+void DmaChnClrEvFlags(DmaChannel chn, unsigned int eFlags);
+void DmaChnClrIntFlag(DmaChannel chn);
+
+#endif
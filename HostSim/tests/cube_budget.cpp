@@ -0,0 +1,249 @@
+/******************************************************************************
+Current budget test for the LEDCube library (CUBE_LAYER_BUDGET_MA,
+CUBE_TLC_BUDGET_MA).
+
+	Runs a long random mix of set(), setRange(), fill(), setAll(), clearLayer(),
+shiftChannels(), rotateLayers(), rotate90(), mirror(), transpose() and
+getWorkData() with setLayerDirty() on the working buffer, with plenty of full
+white so the budgets come into play. It checks that:
+	- after every call, getLayerCurrent() and getTLCCurrent() of every layer match
+	  the sums of what get() returns, so the running sums never drift
+	- after every present(), every layer the chains latch is the working buffer
+	  scaled by exactly the factor the budgets ask for (and not at all when it is
+	  within them), and neither the layer nor any TLC on it goes over its budget
+	- a full white layer is scaled down and a cleared one is back at full
+It prints what a full white layer packs to. Build with
+
+	g++ -std=gnu++11 -O2 -DCUBE_WORKING_BUFFER=1 -DCUBE_LAYER_BUDGET_MA=1000 \
+		-DCUBE_TLC_BUDGET_MA=150 -IHostSim -ILEDCube \
+		HostSim/tests/cube_budget.cpp LEDCube/LEDCube.cpp LEDCube/Draw.cpp \
+		HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include "cube_chains.h"
+#include <stdio.h>
+
+#if !CUBE_CURRENT_LIMIT
+	#error "Build with -DCUBE_WORKING_BUFFER=1 and CUBE_LAYER_BUDGET_MA and/or CUBE_TLC_BUDGET_MA"
+#endif
+
+#define CALLS		20000
+#define PRESENT_EVERY	50
+
+// The budgets in grayscale units, as the library works them out
+#define LAYER_BUDGET	((uint32_t)CUBE_LAYER_BUDGET_MA * 4095 / CUBE_CHANNEL_MA)
+#define TLC_BUDGET		((uint32_t)CUBE_TLC_BUDGET_MA * 4095 / CUBE_CHANNEL_MA)
+
+static CubeChains *chains;
+static int failed;
+static uint32_t seed = 12345;
+
+static int rnd(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+// Mostly full white and off, so that the budgets get something to do
+static int rndValue(void) {
+	int r = rnd(4);
+	return (r == 0) ? 0 : (r == 1) ? rnd(4096) : 4095;
+}
+
+static void layerSums(int layer, uint32_t *sum, uint32_t *tlcSums) {
+	*sum = 0;
+	for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+		tlcSums[tlc] = 0;
+		for (int i = 0; i < 16; i++) tlcSums[tlc] += Cube.get(layer, tlc * 16 + i);
+		*sum += tlcSums[tlc];
+	}
+}
+
+// The running sums against a rescan of every layer
+static void checkSums(const char *call, int n) {
+	for (int l = 0; l < CUBE_SIZE; l++) {
+		uint32_t sum, tlcSums[NUM_TLCS];
+		layerSums(l, &sum, tlcSums);
+
+		int bad = (Cube.getLayerCurrent(l) != (int)((uint64_t)sum * CUBE_CHANNEL_MA / 4095));
+		for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+			bad |= (Cube.getTLCCurrent(l, tlc) != (int)(tlcSums[tlc] * CUBE_CHANNEL_MA / 4095));
+		}
+		if (bad) {
+			printf("  call %d, %s: the sums of layer %d don't match its values\n", n, call, l);
+			failed++;
+			return;
+		}
+	}
+}
+
+// The Q16 scale the budgets call for, worked out the long way
+static unsigned int expectedScale(uint32_t sum, const uint32_t *tlcSums) {
+	uint64_t scale = 0x10000;
+
+#if CUBE_LAYER_BUDGET_MA
+	if (sum > LAYER_BUDGET) scale = ((uint64_t)LAYER_BUDGET << 16) / sum;
+#endif
+#if CUBE_TLC_BUDGET_MA
+	for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+		if ((tlcSums[tlc] > TLC_BUDGET) && (((uint64_t)TLC_BUDGET << 16) / tlcSums[tlc] < scale)) {
+			scale = ((uint64_t)TLC_BUDGET << 16) / tlcSums[tlc];
+		}
+	}
+#else
+	(void)tlcSums;
+#endif
+	return scale;
+}
+
+static void scanLayer(void) {
+	Cube.startUpdate();
+	Cube.finishUpdate();
+	while (Cube.updateInProgress()) SimIdle();
+}
+
+static uint32_t highestLayer, highestTLC;
+static int scaledLayers;
+
+// Presents and scans every layer, checking what the chains latch
+static void presentAndCheck(int n) {
+	Cube.present();
+
+	for (int i = 0; i < CUBE_SIZE; i++) {
+		int layer = Cube.getCurrentLayer();
+		scanLayer();
+
+		uint32_t sum, tlcSums[NUM_TLCS];
+		layerSums(layer, &sum, tlcSums);
+		unsigned int scale = expectedScale(sum, tlcSums);
+		if (scale < 0x10000) scaledLayers++;
+
+		uint32_t latched = 0, latchedTLC[NUM_TLCS] = { 0 };
+		int wrong = 0;
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			int gs = chains->gs(c);
+			wrong += (gs != (int)((Cube.get(layer, c) * scale) >> 16));
+			latched += gs;
+			latchedTLC[c / 16] += gs;
+		}
+		if (wrong) {
+			printf("  call %d: layer %d latched %d channels that aren't scaled as the budgets ask\n", n, layer, wrong);
+			failed++;
+		}
+
+		if (latched > highestLayer) highestLayer = latched;
+#if CUBE_LAYER_BUDGET_MA
+		if (latched > LAYER_BUDGET) {
+			printf("  call %d: layer %d latched %u, over the budget of %u\n", n, layer, latched, LAYER_BUDGET);
+			failed++;
+		}
+#endif
+		for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+			if (latchedTLC[tlc] > highestTLC) highestTLC = latchedTLC[tlc];
+#if CUBE_TLC_BUDGET_MA
+			if (latchedTLC[tlc] > TLC_BUDGET) {
+				printf("  call %d: TLC %d of layer %d latched %u, over the budget of %u\n", n, tlc, layer, latchedTLC[tlc], TLC_BUDGET);
+				failed++;
+			}
+#endif
+		}
+	}
+}
+
+static const char* randomCall(void) {
+	int layer = rnd(CUBE_SIZE);
+	int first = rnd(NUM_CHANNELS);
+	int count = 1 + rnd(NUM_CHANNELS - first);
+
+	switch (rnd(11)) {
+	case 0:
+		Cube.set(layer, first, rndValue());
+		return "set()";
+	case 1: {
+		uint16_t values[NUM_CHANNELS];
+		for (int i = 0; i < count; i++) values[i] = rndValue();
+		Cube.setRange(layer, first, values, count);
+		return "setRange()";
+	}
+	case 2:
+		Cube.fill(layer, first, count, rndValue());
+		return "fill()";
+	case 3:
+		Cube.shiftChannels(layer, first, count, rnd(2 * count + 1) - count, rnd(2));
+		return "shiftChannels()";
+	case 4:
+		Cube.rotateLayers(rnd(2 * CUBE_SIZE + 1) - CUBE_SIZE);
+		return "rotateLayers()";
+	case 5:
+		Cube.rotate90(rnd(3), rnd(7) - 3);
+		return "rotate90()";
+	case 6:
+		Cube.mirror(rnd(3));
+		return "mirror()";
+	case 7:
+		Cube.transpose();
+		return "transpose()";
+	case 8: {
+		uint16_t *values = Cube.getWorkData(layer);
+		for (int i = 0; i < count; i++) values[first + i] = rndValue();
+		Cube.setLayerDirty(layer);
+		return "getWorkData()";
+	}
+	case 9:
+		// Rarely, or there would hardly be anything to scale
+		if (rnd(8)) return "nothing";
+		Cube.setAll(rndValue());
+		return "setAll()";
+	default:
+		Cube.clearLayer(layer);
+		return "clearLayer()";
+	}
+}
+
+int main() {
+	CubeChains sim;
+	chains = &sim;
+
+	Cube.init(0);
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	Cube.stopRefresh();
+#endif
+
+	// A full white layer, then the same layer cleared
+	Cube.fill(0, 0, NUM_CHANNELS, 4095);
+	presentAndCheck(0);
+	uint32_t whiteSum = 0;
+	int whiteValue = 0;
+	for (int i = 0; i < CUBE_SIZE; i++) {
+		if (Cube.getCurrentLayer() == 0) {
+			scanLayer();
+			whiteValue = chains->gs(0);
+			for (int c = 0; c < NUM_CHANNELS; c++) whiteSum += chains->gs(c);
+		} else {
+			scanLayer();
+		}
+	}
+	if (whiteValue >= 4095) {
+		printf("  a full white layer wasn't scaled down\n");
+		failed++;
+	}
+	Cube.clearLayer(0);
+	Cube.set(0, 5, 4095);
+	presentAndCheck(0);
+
+	for (int n = 1; n <= CALLS && !failed; n++) {
+		const char *call = randomCall();
+		checkSums(call, n);
+		if (n % PRESENT_EVERY == 0) presentAndCheck(n);
+	}
+
+	printf("budgets: layer %d mA, TLC %d mA (0 is none): %s\n", CUBE_LAYER_BUDGET_MA, CUBE_TLC_BUDGET_MA,
+	       failed ? "FAILED" : "sums match every rescan, every layer latched within budget");
+	printf("  full white layer packs to %d per channel, %d mA; highest layer %d mA, TLC %d mA; %d of %d layers scaled\n",
+	       whiteValue, (int)((uint64_t)whiteSum * CUBE_CHANNEL_MA / 4095),
+	       (int)((uint64_t)highestLayer * CUBE_CHANNEL_MA / 4095), (int)(highestTLC * CUBE_CHANNEL_MA / 4095),
+	       scaledLayers, (CALLS / PRESENT_EVERY + 2) * CUBE_SIZE);
+
+	return failed ? 1 : 0;
+}
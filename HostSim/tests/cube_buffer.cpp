@@ -0,0 +1,206 @@
+/******************************************************************************
+Double buffer test for the LEDCube library (CUBE_DOUBLE_BUFFER).
+
+	Every frame redraws two layers of the one before it, and the rest has to come
+from the frame that was presented: after presentPending() returns 0 the test
+only sets those two layers. Each frame is presented at a different point of
+the scan. With CUBE_WORKING_BUFFER, every third frame is followed by another one
+without waiting for presentPending(). The test checks that:
+	- every scan the chains latch, layer 0 to CUBE_SIZE - 1, is one whole frame
+	  that was presented, never layers of two
+	- once presentPending() returns 0, get() returns the frame just presented, so
+	  drawing carries on from it
+	- the last frame presented is the one on show
+for a manual scan with startUpdate() and finishUpdate() and, with
+DATA_TRANSFER_MODE TLC_SPI_DMA, for the refresh engine. Build with
+
+	g++ -std=gnu++11 -O2 -DCUBE_DOUBLE_BUFFER=1 -IHostSim -ILEDCube \
+		HostSim/tests/cube_buffer.cpp LEDCube/LEDCube.cpp LEDCube/Draw.cpp \
+		HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+adding -DCUBE_WORKING_BUFFER=1 or another DATA_TRANSFER_MODE, or run
+HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include "cube_chains.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !CUBE_DOUBLE_BUFFER
+	#error "Build with -DCUBE_DOUBLE_BUFFER=1"
+#endif
+
+#define FRAMES		24
+#define TIMEOUT		200000000ULL	// cycles, 2.5s of simulated time
+
+static CubeChains *chains;
+static uint16_t frames[4 * FRAMES + 1][CUBE_SIZE][NUM_CHANNELS];
+static int numFrames;			// frames[0] is what init(0) leaves
+static uint16_t scan[CUBE_SIZE][NUM_CHANNELS];
+static int scanLayers;			// layers of scan latched so far, in order from 0
+static unsigned long scans;
+static int failed;
+
+static void fail(const char *what) {
+	printf("  %s\n", what);
+	failed++;
+}
+
+// Index of the frame that matches scan, or -1
+static int scanFrame(void) {
+	for (int f = numFrames - 1; f >= 0; f--) {
+		if (!memcmp(frames[f], scan, sizeof(scan))) return f;
+	}
+	return -1;
+}
+
+// Called after every XLAT. The layer being latched is still getCurrentLayer(),
+// the scan only moves on after it.
+static void logLatch(int vprg) {
+	if (vprg) return;
+
+	int layer = Cube.getCurrentLayer();
+	if (layer != scanLayers) {
+		scanLayers = 0;
+		if (layer) return;
+	}
+	for (int c = 0; c < NUM_CHANNELS; c++) scan[layer][c] = chains->gs(c);
+
+	if (++scanLayers == CUBE_SIZE) {
+		if (scanFrame() < 0 && !failed) {
+			printf("  scan %lu latched layers of more than one frame\n", scans);
+			failed++;
+		}
+		scans++;
+		scanLayers = 0;
+	}
+}
+
+// Frame f redraws layers f and f + CUBE_SIZE / 2 of frame f - 1
+static void drawFrame(void) {
+	int f = numFrames++;
+	memcpy(frames[f], frames[f - 1], sizeof(frames[0]));
+
+	for (int i = 0; i < 2; i++) {
+		int l = (f + i * CUBE_SIZE / 2) % CUBE_SIZE;
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			frames[f][l][c] = (f * 2311 + l * 997 + c * 7 + 1) & 0xFFF;
+			Cube.set(l, c, frames[f][l][c]);
+		}
+	}
+	Cube.present();
+}
+
+// Checks that the back buffer holds the frame that was presented last
+static void checkBackBuffer(const char *mode) {
+	int f = numFrames - 1;
+
+	for (int l = 0; l < CUBE_SIZE; l++) {
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			if (Cube.get(l, c) != frames[f][l][c]) {
+				printf("  %s: frame %d isn't in the back buffer after presentPending()\n", mode, f);
+				failed++;
+				return;
+			}
+		}
+	}
+}
+
+static void scanLayer(void) {
+	Cube.startUpdate();
+	Cube.finishUpdate();
+	while (Cube.updateInProgress()) SimIdle();
+}
+
+static void manualScan(void) {
+	for (int i = 0; i < FRAMES; i++) {
+		// Present at a different layer each time
+		for (int l = 0; l < i % (CUBE_SIZE + 1); l++) scanLayer();
+
+		drawFrame();
+#if CUBE_WORKING_BUFFER
+		// Drawing doesn't have to wait for presentPending(): every third frame the
+		// swap goes by unseen and the next frame is drawn over it
+		if (i % 3 == 0) {
+			for (int l = 0; l <= CUBE_SIZE; l++) scanLayer();
+			drawFrame();
+		}
+#endif
+		int layers = 0;
+		while (Cube.presentPending() && layers <= CUBE_SIZE) {
+			scanLayer();
+			layers++;
+		}
+		if (Cube.presentPending()) fail("manual scan: present() never swapped");
+		checkBackBuffer("manual scan");
+	}
+	for (int l = 0; l < 2 * CUBE_SIZE; l++) scanLayer();
+}
+
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+static void waitScans(unsigned long count) {
+	unsigned long until = scans + count;
+	uint64_t start = SimCycles();
+
+	while (scans < until && SimCycles() - start < TIMEOUT) SimIdle();
+}
+
+static void refreshScan(void) {
+	Cube.startRefresh();
+
+	for (int i = 0; i < FRAMES; i++) {
+		// Present at a different point of the scan each time
+		SimAdvance((uint64_t)i * 47111);
+
+		drawFrame();
+	#if CUBE_WORKING_BUFFER
+		if (i % 3 == 0) {
+			waitScans(2);
+			drawFrame();
+		}
+	#endif
+		uint64_t start = SimCycles();
+		while (Cube.presentPending() && SimCycles() - start < TIMEOUT) SimIdle();
+		if (Cube.presentPending()) fail("refresh engine: present() never swapped");
+		checkBackBuffer("refresh engine");
+	}
+	waitScans(2);
+	Cube.stopRefresh();
+}
+#endif
+
+// The last scan latched has to be the last frame presented
+static void checkShown(const char *mode) {
+	if (scanFrame() != numFrames - 1) {
+		printf("  %s: the last frame presented isn't on show\n", mode);
+		failed++;
+	}
+}
+
+int main() {
+	CubeChains sim;
+	chains = &sim;
+	sim.setOnLatch(logLatch);
+
+	Cube.init(0);
+	numFrames = 1;
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	Cube.stopRefresh();
+#endif
+
+	manualScan();
+	checkShown("manual scan");
+	unsigned long manualScans = scans;
+
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	refreshScan();
+	checkShown("refresh engine");
+#endif
+
+	printf("double buffer%s, manual scan%s: %s\n", CUBE_WORKING_BUFFER ? ", working buffer" : "",
+	       DATA_TRANSFER_MODE == TLC_SPI_DMA ? " and refresh engine" : "",
+	       failed ? "FAILED" : "every scan one whole frame, drawing carries on from it");
+	printf("  %d frames, %lu scans checked (%lu manual)\n", numFrames - 1, scans, manualScans);
+
+	return failed ? 1 : 0;
+}
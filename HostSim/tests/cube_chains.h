@@ -0,0 +1,107 @@
+/******************************************************************************
+Simulated TLC5940 chains wired the way the LEDCube build being tested expects.
+
+	One chain on SPI2 for TLC_SPI, TLC_SPI_DMA and TLC_BITBANG (which bit-bangs
+the same pins), the second half of the TLCs on SPI1 with CUBE_SPI_CHAINS 2,
+and CUBE_PARALLEL_CHAINS chains with SIN on RB0, RB1, ... for TLC_PARALLEL.
+gs() and dc() take the cube's channel numbers, so a test doesn't have to know
+which chain a channel is on. Included by the HostSim/tests cube programs only.
+******************************************************************************/
+
+#ifndef CUBE_CHAINS_H
+#define CUBE_CHAINS_H
+
+#include <LEDCube.h>
+#include <Tlc5940Sim.h>
+
+#if DATA_TRANSFER_MODE == TLC_PARALLEL
+	#define CUBE_SIM_CHAINS  CUBE_PARALLEL_CHAINS
+#else
+	#define CUBE_SIM_CHAINS  CUBE_SPI_CHAINS
+#endif
+
+#define CUBE_SIM_CHAIN_TLCS  (NUM_TLCS / CUBE_SIM_CHAINS)
+
+// Wiring of chain n
+static Tlc5940SimPins cubeChainPins(int n) {
+	Tlc5940SimPins pins = TLC5940SIM_CUBE_PINS;
+
+#if DATA_TRANSFER_MODE == TLC_PARALLEL
+	pins.sinPort = SIM_PORTB;
+	pins.sinPin = 1u << n;
+#else
+	if (n == 1) {
+		pins.sinPort = SIM_SDO1_PORT;
+		pins.sinPin = SIM_SDO1_PIN;
+		pins.sclkPort = SIM_SCK1_PORT;
+		pins.sclkPin = SIM_SCK1_PIN;
+	}
+#endif
+	return pins;
+}
+
+// A chain that calls CubeChains::onLatch after every XLAT. Only the last chain
+// does, so every chain has latched by then.
+class CubeChain : public Tlc5940Sim {
+  public:
+	CubeChain(int n) : Tlc5940Sim(CUBE_SIM_CHAIN_TLCS, cubeChainPins(n)), last(n == CUBE_SIM_CHAINS - 1) {}
+
+	void (*onLatch)(int vprg);
+
+  protected:
+	virtual void latched(int vprg) {
+		if (last && onLatch) onLatch(vprg);
+	}
+
+  private:
+	int last;
+};
+
+class CubeChains {
+  public:
+	CubeChains() {
+		for (int n = 0; n < CUBE_SIM_CHAINS; n++) {
+			chains[n] = new CubeChain(n);
+			chains[n]->onLatch = 0;
+		}
+	}
+
+	int gs(int channel) const { return chains[channel / (CUBE_SIM_CHAIN_TLCS * 16)]->gs(channel % (CUBE_SIM_CHAIN_TLCS * 16)); }
+	int dc(int channel) const { return chains[channel / (CUBE_SIM_CHAIN_TLCS * 16)]->dc(channel % (CUBE_SIM_CHAIN_TLCS * 16)); }
+
+	// Latches seen by every chain (the fewest of any, so a chain that missed one shows)
+	unsigned long gsLatches(void) const {
+		unsigned long n = chains[0]->gsLatches();
+		for (int i = 1; i < CUBE_SIM_CHAINS; i++) {
+			if (chains[i]->gsLatches() < n) n = chains[i]->gsLatches();
+		}
+		return n;
+	}
+
+	unsigned long dcLatches(void) const {
+		unsigned long n = chains[0]->dcLatches();
+		for (int i = 1; i < CUBE_SIM_CHAINS; i++) {
+			if (chains[i]->dcLatches() < n) n = chains[i]->dcLatches();
+		}
+		return n;
+	}
+
+	uint64_t lastLatchCycle(void) const { return chains[0]->lastLatchCycle(); }
+
+	// Called after every XLAT, once all the chains have latched
+	void setOnLatch(void (*onLatch)(int vprg)) { chains[CUBE_SIM_CHAINS - 1]->onLatch = onLatch; }
+
+	// Number of channels whose latched GS isn't layer of the back buffer
+	int gsDiffers(int layer) const {
+		int n = 0;
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			if (gs(c) != Cube.get(layer, c)) n++;
+		}
+		return n;
+	}
+
+  private:
+	CubeChain *chains[CUBE_SIM_CHAINS];
+};
+
+#endif
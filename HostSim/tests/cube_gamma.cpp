@@ -0,0 +1,88 @@
+/******************************************************************************
+Gamma test for the LEDCube library (CUBE_GAMMA_ENABLED).
+
+	Fills every layer of the working buffer once, then steps through a few
+brightness levels with setBrightness() and present() and nothing else. Every
+layer the simulated chains latch has to be the gamma corrected value of what
+get() returns, round(4095 * (v / 4095) ^ CUBE_GAMMA) of the value scaled by the
+brightness, worked out with pow(). As no layer is redrawn, this checks that
+setBrightness() gets every layer packed again. Build with
+
+	g++ -std=gnu++11 -O2 -DCUBE_GAMMA_ENABLED=1 -DCUBE_WORKING_BUFFER=1 \
+		-IHostSim -ILEDCube HostSim/tests/cube_gamma.cpp LEDCube/LEDCube.cpp \
+		LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+adding -DCUBE_GAMMA=... or -DCUBE_DOUBLE_BUFFER=1, or run
+HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include "cube_chains.h"
+#include <math.h>
+#include <stdio.h>
+
+#if !CUBE_GAMMA_ENABLED
+	#error "Build with -DCUBE_GAMMA_ENABLED=1 -DCUBE_WORKING_BUFFER=1"
+#endif
+
+static uint32_t seed = 12345;
+
+static int rnd(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static int expected(int value, int brightness) {
+	int scaled = (value * (brightness + 1)) >> 8;
+	return (int)floor(4095.0 * pow(scaled / 4095.0, CUBE_GAMMA) + 0.5);
+}
+
+static void scanLayer(void) {
+	Cube.startUpdate();
+	Cube.finishUpdate();
+	while (Cube.updateInProgress()) SimIdle();
+}
+
+int main() {
+	CubeChains chains;
+	int bad = 0;
+
+	Cube.init(0);
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	Cube.stopRefresh();
+#endif
+
+	for (int l = 0; l < CUBE_SIZE; l++) {
+		for (int c = 0; c < NUM_CHANNELS; c++) Cube.set(l, c, rnd(4096));
+		Cube.set(l, 0, 4095);
+		Cube.set(l, 1, 0);
+	}
+
+	static const int brightness[] = { 255, 128, 0, 37, 200 };
+
+	for (unsigned int b = 0; b < sizeof(brightness) / sizeof(brightness[0]); b++) {
+		Cube.setBrightness(brightness[b]);
+		Cube.present();
+		while (Cube.presentPending()) scanLayer();
+
+		int stale = 0;
+		for (int i = 0; i < CUBE_SIZE; i++) {
+			int layer = Cube.getCurrentLayer();
+			scanLayer();
+
+			int wrong = 0;
+			for (int c = 0; c < NUM_CHANNELS; c++) {
+				if (chains.gs(c) != expected(Cube.get(layer, c), brightness[b])) wrong++;
+			}
+			if (wrong) stale++;
+		}
+		if (stale) {
+			printf("  brightness %d: %d layers weren't packed at it\n", brightness[b], stale);
+			bad++;
+		}
+	}
+
+	printf("CUBE_GAMMA %.1f%s: %s\n", (double)CUBE_GAMMA, CUBE_DOUBLE_BUFFER ? ", double buffered" : "",
+	       bad ? "FAILED" : "every layer packed again at every brightness");
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,200 @@
+/******************************************************************************
+Test for LEDCube::rotate90(), mirror() and transpose() and the Draw wrappers
+that move the spectrum with them.
+
+	Every channel of the cube gets its own value, each operation is run and the
+whole cube is compared with where the voxels should have gone, worked out one
+voxel at a time. Quarter turns are checked for every axis and -5 to 5 turns,
+mirrors for every axis, and transpose both directly and against a quarter turn
+about Z followed by a mirror along X. Then the same is done through
+DrawCube.rotateCube90(), mirrorCube() and transposeCube() with a spectrum set
+on some voxels, which has to move with them so increaseRGBSpectrumAll() changes
+the voxels that are lit and nothing else. Build with
+
+	g++ -std=gnu++11 -O2 -IHostSim -ILEDCube HostSim/tests/cube_permute.cpp \
+		LEDCube/LEDCube.cpp LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include <Draw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N	CUBE_SIZE
+
+enum { ROTATE, MIRROR, TRANSPOSE };
+
+typedef uint16_t CubeData[N][NUM_CHANNELS];
+
+static CubeData before, after, expected;
+static int failed = 0;
+
+// Where voxel (x, y, z) comes from after one quarter turn about axis, or a mirror
+// along it, or a transpose
+static void sourceOf(int op, int axis, const int c[3], int s[3]) {
+  s[0] = c[0]; s[1] = c[1]; s[2] = c[2];
+
+  if (op == TRANSPOSE) {
+    s[0] = c[1]; s[1] = c[0];
+  } else if (op == MIRROR) {
+    s[axis] = N - 1 - c[axis];
+  } else if (axis == CUBE_AXIS_X) {
+    // Anticlockwise looking down X from its far end: y goes to z
+    s[1] = c[2]; s[2] = N - 1 - c[1];
+  } else if (axis == CUBE_AXIS_Y) {
+    // z goes to x
+    s[0] = N - 1 - c[2]; s[2] = c[0];
+  } else {
+    // x goes to y
+    s[0] = c[1]; s[1] = N - 1 - c[0];
+  }
+}
+
+// Moves data as op would, times times
+static void model(CubeData data, int op, int axis, int times) {
+  static CubeData from;
+
+  for (int t = 0; t < times; t++) {
+    memcpy(from, data, sizeof(CubeData));
+    int c[3], s[3];
+    for (c[2] = 0; c[2] < N; c[2]++)
+      for (c[0] = 0; c[0] < N; c[0]++)
+        for (c[1] = 0; c[1] < N; c[1]++) {
+          sourceOf(op, axis, c, s);
+          for (int k = 0; k < LED_SIZE; k++) {
+            data[c[2]][(c[0] * N + c[1]) * LED_SIZE + k] = from[s[2]][(s[0] * N + s[1]) * LED_SIZE + k];
+          }
+        }
+  }
+}
+
+static void fillCube(void) {
+  for (int l = 0; l < N; l++)
+    for (int c = 0; c < NUM_CHANNELS; c++)
+      Cube.set(l, c, (l * NUM_CHANNELS + c * 7 + 1) % 4096);
+}
+
+static void snapshot(CubeData data) {
+  for (int l = 0; l < N; l++)
+    for (int c = 0; c < NUM_CHANNELS; c++)
+      data[l][c] = Cube.get(l, c);
+}
+
+static void check(const char *what, int axis, int turns) {
+  snapshot(after);
+  if (memcmp(after, expected, sizeof(CubeData))) {
+    if (failed < 10) printf("  %s axis %d turns %d moved the voxels wrong\n", what, axis, turns);
+    failed++;
+  }
+}
+
+#if RGB_LEDS
+// Spectrum of each voxel as the test expects it
+static int spectrum[N][N][N];
+
+static void checkSpectrum(const char *what, int axis) {
+  DrawCube.increaseRGBSpectrumAll(100);
+
+  for (int x = 0; x < N; x++)
+    for (int y = 0; y < N; y++)
+      for (int z = 0; z < N; z++) {
+        int want = spectrum[x][y][z] ? spectrum[x][y][z] + 100 : 0;
+        if (DrawCube.getRGBVoxelSpectrum(x, y, z) != want) {
+          if (failed < 10) printf("  %s axis %d: voxel %d,%d,%d has spectrum %d, should be %d\n",
+                                  what, axis, x, y, z, DrawCube.getRGBVoxelSpectrum(x, y, z), want);
+          failed++;
+        }
+      }
+}
+
+// Moves the expected spectrum as op would
+static void modelSpectrum(int op, int axis, int times) {
+  static int from[N][N][N];
+
+  for (int t = 0; t < times; t++) {
+    memcpy(from, spectrum, sizeof(spectrum));
+    int c[3], s[3];
+    for (c[0] = 0; c[0] < N; c[0]++)
+      for (c[1] = 0; c[1] < N; c[1]++)
+        for (c[2] = 0; c[2] < N; c[2]++) {
+          sourceOf(op, axis, c, s);
+          spectrum[c[0]][c[1]][c[2]] = from[s[0]][s[1]][s[2]];
+        }
+  }
+}
+
+static void setSpectrumVoxels(void) {
+  DrawCube.clearAll();
+  memset(spectrum, 0, sizeof(spectrum));
+  srand(23);
+  for (int i = 0; i < 40; i++) {
+    int x = rand() % N, y = rand() % N, z = rand() % N;
+    spectrum[x][y][z] = 1 + rand() % 12000;
+    DrawCube.setRGBVoxelSpectrum(x, y, z, spectrum[x][y][z]);
+  }
+}
+#endif
+
+int main() {
+  Cube.init(0);
+
+  for (int axis = CUBE_AXIS_X; axis <= CUBE_AXIS_Z; axis++) {
+    for (int turns = -5; turns <= 5; turns++) {
+      fillCube();
+      snapshot(before);
+      memcpy(expected, before, sizeof(CubeData));
+      model(expected, ROTATE, axis, ((turns % 4) + 4) % 4);
+      Cube.rotate90(axis, turns);
+      check("rotate90", axis, turns);
+    }
+
+    fillCube();
+    snapshot(expected);
+    model(expected, MIRROR, axis, 1);
+    Cube.mirror(axis);
+    check("mirror", axis, 1);
+    Cube.mirror(axis);
+    model(expected, MIRROR, axis, 1);
+    check("mirror twice", axis, 2);
+  }
+
+  fillCube();
+  snapshot(expected);
+  model(expected, TRANSPOSE, 0, 1);
+  Cube.transpose();
+  check("transpose", 0, 1);
+
+  fillCube();
+  Cube.rotate90(CUBE_AXIS_Z, 1);
+  Cube.mirror(CUBE_AXIS_X);
+  snapshot(expected);
+  fillCube();
+  Cube.transpose();
+  check("transpose against rotate90 and mirror", CUBE_AXIS_Z, 1);
+
+#if RGB_LEDS
+  for (int axis = CUBE_AXIS_X; axis <= CUBE_AXIS_Z; axis++) {
+    for (int turns = -1; turns <= 2; turns++) {
+      setSpectrumVoxels();
+      DrawCube.rotateCube90(axis, turns);
+      modelSpectrum(ROTATE, axis, (turns + 4) % 4);
+      checkSpectrum("rotateCube90", axis);
+    }
+
+    setSpectrumVoxels();
+    DrawCube.mirrorCube(axis);
+    modelSpectrum(MIRROR, axis, 1);
+    checkSpectrum("mirrorCube", axis);
+  }
+
+  setSpectrumVoxels();
+  DrawCube.transposeCube();
+  modelSpectrum(TRANSPOSE, 0, 1);
+  checkSpectrum("transposeCube", 0);
+#endif
+
+  printf("rotate90/mirror/transpose: %s\n", failed ? "FAILED" : "every voxel and its spectrum where it should be");
+  return failed ? 1 : 0;
+}
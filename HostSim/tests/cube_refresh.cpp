@@ -0,0 +1,200 @@
+/******************************************************************************
+Test for the LEDCube refresh engine (startRefresh(), DATA_TRANSFER_MODE
+TLC_SPI_DMA).
+
+	Every layer of every frame gets its own values, and every XLAT the
+simulated chains see is logged as the layer and frame they latched. The test
+checks that:
+	- the engine latches the layers in order, 0 to CUBE_SIZE - 1 and round again,
+	  and never a layer that mixes two frames or isn't one at all
+	- updateDC() while the engine runs gets the dot correction latched,
+	  updateInProgress() stays 1 until it has been and then drops to 0, and the
+	  layers carry on in order around it
+	- a DC still queued when stopRefresh() is called goes out all the same
+	- with CUBE_DOUBLE_BUFFER, present() only swaps after the last layer, so a
+	  new frame always starts at layer 0
+It prints the cycles per layer and how long the DC took. Build with
+
+	g++ -std=gnu++11 -O2 -DCUBE_AUTO_REFRESH=1 -IHostSim -ILEDCube \
+		HostSim/tests/cube_refresh.cpp LEDCube/LEDCube.cpp LEDCube/Draw.cpp \
+		HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+adding -DCUBE_DOUBLE_BUFFER=1, -DCUBE_WORKING_BUFFER=1 or -DCUBE_SPI_CHAINS=2,
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include "cube_chains.h"
+#include <stdio.h>
+
+#if DATA_TRANSFER_MODE != TLC_SPI_DMA
+	#error "The refresh engine needs DATA_TRANSFER_MODE TLC_SPI_DMA"
+#endif
+
+#define FRAMES		4
+#define LOG_SIZE	4096
+#define TIMEOUT		200000000ULL	// cycles, 2.5s of simulated time
+
+// What each XLAT latched: frame * CUBE_SIZE + layer, DC_LATCH, or NOT_A_LAYER
+#define DC_LATCH	-1
+#define NOT_A_LAYER	-2
+
+static CubeChains *chains;
+static int latchLog[LOG_SIZE];
+static uint64_t latchCycle[LOG_SIZE];
+static int numLatches;
+static int failed;
+
+static int value(int frame, int layer, int channel) {
+	return (frame * 2311 + layer * 997 + channel * 7 + 1) & 0xFFF;
+}
+
+static void logLatch(int vprg) {
+	if (numLatches == LOG_SIZE) return;
+
+	int what = NOT_A_LAYER;
+	if (vprg) {
+		what = DC_LATCH;
+	} else {
+		for (int f = 0; f < FRAMES && what == NOT_A_LAYER; f++) {
+			for (int l = 0; l < CUBE_SIZE; l++) {
+				int c = 0;
+				while (c < NUM_CHANNELS && chains->gs(c) == value(f, l, c)) c++;
+				if (c == NUM_CHANNELS) {
+					what = f * CUBE_SIZE + l;
+					break;
+				}
+			}
+		}
+	}
+	latchCycle[numLatches] = SimCycles();
+	latchLog[numLatches++] = what;
+}
+
+static void fail(const char *what) {
+	printf("  %s\n", what);
+	failed++;
+}
+
+// Waits for count more latches of any kind
+static void waitLatches(int count) {
+	int until = numLatches + count;
+	uint64_t start = SimCycles();
+
+	while (numLatches < until && SimCycles() - start < TIMEOUT) SimIdle();
+}
+
+static void drawFrame(int frame) {
+	for (int l = 0; l < CUBE_SIZE; l++)
+		for (int c = 0; c < NUM_CHANNELS; c++)
+			Cube.set(l, c, value(frame, l, c));
+	Cube.present();
+}
+
+// Checks the layers logged from entry first on: each one the layer after the last,
+// frames only changing from the last layer of one to layer 0 of the next
+static void checkOrder(int first, const char *what) {
+	int previous = -1;
+
+	for (int i = first; i < numLatches; i++) {
+		int entry = latchLog[i];
+		if (entry == DC_LATCH) continue;
+		if (entry == NOT_A_LAYER) {
+			printf("  %s: latch %d isn't a layer of any frame\n", what, i);
+			failed++;
+			return;
+		}
+		if (previous >= 0) {
+			int layer = entry % CUBE_SIZE, frame = entry / CUBE_SIZE;
+			int lastLayer = previous % CUBE_SIZE, lastFrame = previous / CUBE_SIZE;
+			if (layer != (lastLayer + 1) % CUBE_SIZE ||
+			    (frame != lastFrame && (layer != 0 || frame < lastFrame))) {
+				printf("  %s: frame %d layer %d latched after frame %d layer %d\n", what, frame, layer, lastFrame, lastLayer);
+				failed++;
+				return;
+			}
+		}
+		previous = entry;
+	}
+}
+
+static int dcValue(int pass, int channel) {
+	return (channel * 5 + pass * 17 + 1) & 63;
+}
+
+static int dcDiffers(int pass) {
+	int n = 0;
+	for (int c = 0; c < NUM_CHANNELS; c++) {
+		if (chains->dc(c) != dcValue(pass, c)) n++;
+	}
+	return n;
+}
+
+int main() {
+	CubeChains sim;
+	chains = &sim;
+	sim.setOnLatch(logLatch);
+
+	Cube.init(0);
+	drawFrame(0);
+	while (Cube.presentPending()) SimIdle();
+	if (!Cube.refreshRunning()) Cube.startRefresh();
+
+	// Layers that were being sent while frame 0 was drawn aren't checked
+	waitLatches(2);
+	int first = numLatches;
+	waitLatches(3 * CUBE_SIZE);
+	checkOrder(first, "scan");
+	double layerCycles = (double)(latchCycle[numLatches - 1] - latchCycle[first]) / (numLatches - 1 - first);
+
+	// Dot correction while the engine runs
+	for (int c = 0; c < NUM_CHANNELS; c++) Cube.setDC(c, dcValue(0, c));
+	int dcFirst = numLatches;
+	uint64_t start = SimCycles();
+	if (Cube.updateDC()) fail("updateDC() while the engine runs returned 1");
+	if (!Cube.updateInProgress()) fail("updateInProgress() is 0 straight after updateDC()");
+	while (Cube.updateInProgress() && SimCycles() - start < TIMEOUT) SimIdle();
+	uint64_t dcCycles = SimCycles() - start;
+
+	if (Cube.updateInProgress()) fail("updateInProgress() never dropped after updateDC()");
+	if (dcDiffers(0)) fail("the DC sent while the engine runs wasn't latched");
+	int dcLatches = 0;
+	for (int i = dcFirst; i < numLatches; i++) dcLatches += (latchLog[i] == DC_LATCH);
+	if (dcLatches != 1) fail("updateDC() didn't latch the DC exactly once");
+
+	waitLatches(2 * CUBE_SIZE);
+	checkOrder(first, "scan around the DC");
+
+	// A DC that is still queued when the engine is stopped
+	for (int c = 0; c < NUM_CHANNELS; c++) Cube.setDC(c, dcValue(1, c));
+	Cube.updateDC();
+	Cube.stopRefresh();
+	start = SimCycles();
+	while (Cube.updateInProgress() && SimCycles() - start < TIMEOUT) SimIdle();
+	if (dcDiffers(1)) fail("a DC queued before stopRefresh() wasn't latched");
+
+	Cube.startRefresh();
+	waitLatches(2);
+
+#if CUBE_DOUBLE_BUFFER
+	// New frames while the engine runs: each one only from layer 0
+	first = numLatches;
+	for (int f = 1; f < FRAMES; f++) {
+		drawFrame(f);
+		start = SimCycles();
+		while (Cube.presentPending() && SimCycles() - start < TIMEOUT) SimIdle();
+		if (Cube.presentPending()) fail("present() never swapped");
+		waitLatches(CUBE_SIZE / 2 + f);
+	}
+	waitLatches(CUBE_SIZE);
+	checkOrder(first, "present()");
+	if (latchLog[numLatches - 1] / CUBE_SIZE != FRAMES - 1) fail("the last frame presented isn't on show");
+#endif
+	Cube.stopRefresh();
+
+	printf("refresh engine, %d chain%s%s%s: %s\n", CUBE_SPI_CHAINS, CUBE_SPI_CHAINS > 1 ? "s" : "",
+	       CUBE_DOUBLE_BUFFER ? ", double buffered" : "", CUBE_WORKING_BUFFER ? ", working buffer" : "",
+	       failed ? "FAILED" : "layers in order, DC latched, frames whole");
+	printf("  %.0f cycles per layer, updateDC() latched after %.0f cycles\n", layerCycles, (double)dcCycles);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+/******************************************************************************
+Transfer test for the LEDCube library.
+
+	Sends the dot correction and two whole frames of grayscale data, one layer
+at a time as a sketch scanning the cube by hand would, through whichever
+DATA_TRANSFER_MODE, CUBE_SPI_CHAINS or CUBE_PARALLEL_CHAINS the library is
+built with (see cube_chains.h for the wiring), and checks that every chain
+latched exactly the DC that was set and each layer of the back buffer. It
+prints what one layer costs: cycles until its last bit is out of the SPI
+module(s), which TLC_BITBANG and TLC_PARALLEL don't use, and port register
+writes, which is what the bit-banged modes cost since register writes take no
+simulated time (see HostSim.h). Build with
+
+	g++ -std=gnu++11 -O2 -DCUBE_SPI_CHAINS=2 -IHostSim -ILEDCube \
+		HostSim/tests/cube_transfer.cpp LEDCube/LEDCube.cpp LEDCube/Draw.cpp \
+		HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if anything was latched wrong.
+******************************************************************************/
+
+#include "cube_chains.h"
+#include <plib.h>
+#include <stdio.h>
+
+#define SCANS	2
+
+static const char* modeName(void)
+{
+#if DATA_TRANSFER_MODE == TLC_BITBANG
+	return "TLC_BITBANG";
+#elif DATA_TRANSFER_MODE == TLC_PARALLEL
+	return "TLC_PARALLEL";
+#elif DATA_TRANSFER_MODE == TLC_SPI
+	return "TLC_SPI";
+#else
+	return "TLC_SPI_DMA";
+#endif
+}
+
+// Whether either SPI module still has bits to shift out
+static int spiBusy(void)
+{
+	return SpiChnIsBusy(SPI_CHANNEL2) || SpiChnIsBusy(SPI_CHANNEL1);
+}
+
+int main()
+{
+	CubeChains chains;
+	int bad = 0;
+
+	Cube.init(0);
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	Cube.stopRefresh();
+#endif
+
+#if VPRG_ENABLED
+	for (int c = 0; c < NUM_CHANNELS; c++) {
+		Cube.setDC(c, (c * 5 + 3) & 63);
+	}
+	while (Cube.updateDC()) SimIdle();
+	while (Cube.updateInProgress()) SimIdle();
+
+	int dcBad = 0;
+	for (int c = 0; c < NUM_CHANNELS; c++) {
+		if (chains.dc(c) != ((c * 5 + 3) & 63)) dcBad++;
+	}
+	if (dcBad) printf("  %d channels latched the wrong DC\n", dcBad);
+	bad += dcBad;
+#endif
+
+	uint64_t sendCycles = 0;
+	unsigned long portWrites = 0;
+	int layers = 0;
+
+	for (int scan = 0; scan < SCANS; scan++) {
+		for (int l = 0; l < CUBE_SIZE; l++) {
+			for (int c = 0; c < NUM_CHANNELS; c++) {
+				Cube.set(l, c, (scan * 1409 + l * 1000 + c * 7) & 0xFFF);
+			}
+		}
+		Cube.present();
+		while (Cube.presentPending()) SimIdle();
+
+		for (int i = 0; i < CUBE_SIZE; i++) {
+			int layer = Cube.getCurrentLayer();
+			unsigned long writes = SimPortWrites();
+			uint64_t start = SimCycles();
+
+			Cube.startUpdate();
+			while (Cube.updateStatus() == CUBE_UPDATE_SHIFTING || spiBusy()) SimIdle();
+			sendCycles += SimCycles() - start;
+			portWrites += SimPortWrites() - writes;
+
+			Cube.finishUpdate();
+			while (Cube.updateInProgress()) SimIdle();
+
+			int layerBad = chains.gsDiffers(layer);
+			if (layerBad) printf("  scan %d layer %d: %d channels latched wrong\n", scan, layer, layerBad);
+			bad += layerBad;
+			layers++;
+		}
+	}
+
+	printf("%s, %d chain%s of %d TLCs: %s\n", modeName(), CUBE_SIM_CHAINS, CUBE_SIM_CHAINS > 1 ? "s" : "",
+	       CUBE_SIM_CHAIN_TLCS, bad ? "FAILED" : "DC and every layer latched");
+#if DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+	printf("  %.0f port register writes per layer\n", (double)portWrites / layers);
+#else
+	printf("  %.0f cycles to send a layer, %.0f port register writes per layer\n",
+	       (double)sendCycles / layers, (double)portWrites / layers);
+#endif
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/******************************************************************************
+Current limiting test for the Draw RGB primitives.
+
+	Draws lines, filled boxes and cubes, planes and a sprite in colours inside
+and outside the spectrum (including greys), and checks each one leaves exactly
+the colours and spectrum values that setRGBVoxel() gives the same voxels, so
+LIMIT_CURRENT applies to all of them. Build with
+
+	g++ -std=gnu++11 -O2 -IHostSim -ILEDCube HostSim/tests/draw_limit.cpp \
+		LEDCube/LEDCube.cpp LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+and -DLIMIT_CURRENT=0 to check the unlimited build, or run
+HostSim/tests/run_tests.sh. Exits with 1 if any primitive differs.
+******************************************************************************/
+
+#include <Draw.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PRIMITIVES  8
+
+typedef uint16_t CubeData[CUBE_SIZE][NUM_CHANNELS];
+typedef int SpectrumData[CUBE_SIZE][CUBE_SIZE][CUBE_SIZE];
+
+static uint8_t spriteRuns[CUBE_SIZE * CUBE_SIZE * 2];
+static uint16_t spritePalette[2][3];
+static const DrawSprite sprite = { CUBE_SIZE - 2, CUBE_SIZE, 3, spritePalette, spriteRuns };
+
+static void drawPrimitive(int primitive, int red, int green, int blue) {
+  switch (primitive) {
+    case 0: DrawCube.drawRGBLine(0, 1, 2, CUBE_SIZE - 1, CUBE_SIZE - 3, CUBE_SIZE - 2, red, green, blue); break;
+    case 1: DrawCube.drawRGBLine(-3, CUBE_SIZE + 2, 1, CUBE_SIZE, -1, CUBE_SIZE - 1, red, green, blue); break;
+    case 2: DrawCube.drawFillRGBBox(1, 0, 2, CUBE_SIZE - 2, 3, CUBE_SIZE, 3, red, green, blue); break;
+    case 3: DrawCube.drawFillRGBCube(1, 1, 0, 6, 3, red, green, blue); break;
+    case 4: DrawCube.setRGBPlaneX(2, red, green, blue); break;
+    case 5: DrawCube.setRGBPlaneY(CUBE_SIZE - 1, red, green, blue); break;
+    case 6: DrawCube.setRGBPlaneZ(1, red, green, blue); break;
+    case 7:
+      spritePalette[1][0] = red;
+      spritePalette[1][1] = green;
+      spritePalette[1][2] = blue;
+      DrawCube.blit(&sprite, 1, 0, CUBE_SIZE - 2, DRAW_BLIT_FLIP_Z);
+      break;
+  }
+}
+
+static void snapshot(CubeData data, SpectrumData spectrum) {
+  for (int l = 0; l < CUBE_SIZE; l++)
+    for (int c = 0; c < NUM_CHANNELS; c++)
+      data[l][c] = Cube.get(l, c);
+
+  for (int x = 0; x < CUBE_SIZE; x++)
+    for (int y = 0; y < CUBE_SIZE; y++)
+      for (int z = 0; z < CUBE_SIZE; z++)
+        spectrum[x][y][z] = DrawCube.getRGBVoxelSpectrum(x, y, z);
+}
+
+static unsigned int seed = 1;
+
+static int nextValue(int range) {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % range;
+}
+
+int main() {
+  static CubeData drawn, expected;
+  static SpectrumData drawnSpectrum, expectedSpectrum, voxels;
+  int failed = 0, tested = 0;
+
+  // Every row of the sprite is one run of palette colour 1
+  for (int i = 0; i < CUBE_SIZE * CUBE_SIZE; i++) {
+    spriteRuns[2 * i] = CUBE_SIZE;
+    spriteRuns[2 * i + 1] = 1;
+  }
+
+  for (int c = 0; c < 200; c++) {
+    int red, green, blue;
+
+    if (c < 8) {
+      // Greys, in and out of the spectrum
+      red = green = blue = (c * 4095) / 7;
+    } else {
+      red = nextValue(4096);
+      green = nextValue(4096);
+      blue = (c & 1) ? nextValue(4096) : 0;
+    }
+
+    for (int p = 0; p < PRIMITIVES; p++) {
+      // Which voxels the primitive lights, in a colour that is never limited
+      DrawCube.clearAll();
+      drawPrimitive(p, 0, 0, 1);
+      snapshot(drawn, voxels);
+
+      DrawCube.clearAll();
+      drawPrimitive(p, red, green, blue);
+      snapshot(drawn, drawnSpectrum);
+
+      DrawCube.clearAll();
+      for (int x = 0; x < CUBE_SIZE; x++)
+        for (int y = 0; y < CUBE_SIZE; y++)
+          for (int z = 0; z < CUBE_SIZE; z++)
+            if (voxels[x][y][z]) DrawCube.setRGBVoxel(x, y, z, red, green, blue);
+      snapshot(expected, expectedSpectrum);
+
+      tested++;
+      if (memcmp(drawn, expected, sizeof(CubeData)) || memcmp(drawnSpectrum, expectedSpectrum, sizeof(SpectrumData))) {
+        if (failed < 10) printf("  primitive %d differs from setRGBVoxel() for %d,%d,%d\n", p, red, green, blue);
+        failed++;
+      }
+    }
+  }
+
+  printf("RGB primitives with LIMIT_CURRENT %d: %d colour and primitive pairs, %s\n",
+         LIMIT_CURRENT, tested, failed ? "FAILED" : "all match setRGBVoxel()");
+  return failed ? 1 : 0;
+}
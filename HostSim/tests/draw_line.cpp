@@ -0,0 +1,207 @@
+/******************************************************************************
+Line test for Draw::drawRGBLine().
+
+	Compares the integer Bresenham drawRGBLine() with the float implementation
+it replaced (copied below as oldLine()) over every pair of end points in the
+cube, and times both. Axis-aligned and 45 degree lines must draw exactly the
+same voxels. Other lines may differ: the old code truncated the minor axes and
+drawRGBLine() rounds them to the nearest voxel (halves towards the start of the
+line), so those are only required to draw one voxel per step of the major
+axis; the number that differ is printed. A zero-length line draws its voxel
+now, where the old code drew nothing.
+
+	It also checks that swapping the ends draws the same voxels, and that lines
+with ends outside the cube draw exactly the voxels of the whole line that are
+inside. Build with
+
+	g++ -std=gnu++11 -O2 -IHostSim -ILEDCube HostSim/tests/draw_line.cpp \
+		LEDCube/LEDCube.cpp LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include <Draw.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+typedef char VoxelSet[CUBE_SIZE][CUBE_SIZE][CUBE_SIZE];
+
+// drawRGBLine() as it was before it moved to integer Bresenham
+static void oldLine(int x1, int y1, int z1, int x2, int y2, int z2, int red, int green, int blue) {
+  int dx,dy,dz;
+
+  if( x1 >= x2 ) { dx = x1 - x2; } else { dx = x2 - x1; }
+  if( y1 >= y2 ) { dy = y1 - y2; } else { dy = y2 - y1; }
+  if( z1 >= z2 ) { dz = z1 - z2; } else { dz = z2 - z1; }
+
+  if((dx >= dy) && (dx >= dz)) {
+    float xy, xz;
+    int x,y,z;
+    if (x1 > x2) {
+      int tmp;
+      tmp = x2; x2 = x1; x1 = tmp;
+      tmp = y2; y2 = y1; y1 = tmp;
+      tmp = z2; z2 = z1; z1 = tmp;
+    }
+    xy = (float)(y2-y1)/(float)(x2-x1);
+    xz = (float)(z2-z1)/(float)(x2-x1);
+    for (x = x1; x <= x2; x++) {
+      y = (int)(xy * (x - x1)) + y1;
+      z = (int)(xz * (x - x1)) + z1;
+      DrawCube.setRGBVoxel(x, y, z, red, green, blue);
+    }
+  } else if ((dy >= dx) && (dy >= dz)) {
+    float yx, yz;
+    int x,y,z;
+    if (y1 > y2) {
+      int tmp;
+      tmp = x2; x2 = x1; x1 = tmp;
+      tmp = y2; y2 = y1; y1 = tmp;
+      tmp = z2; z2 = z1; z1 = tmp;
+    }
+    yx = (float)(x2-x1)/(float)(y2-y1);
+    yz = (float)(z2-z1)/(float)(y2-y1);
+    for (y = y1; y <= y2; y++) {
+      x = (int)(yx * (y - y1)) + x1;
+      z = (int)(yz * (y - y1)) + z1;
+      DrawCube.setRGBVoxel(x, y, z, red, green, blue);
+    }
+  } else {
+    float zx, zy;
+    int x,y,z;
+    if (z1 > z2) {
+      int tmp;
+      tmp = x2; x2 = x1; x1 = tmp;
+      tmp = y2; y2 = y1; y1 = tmp;
+      tmp = z2; z2 = z1; z1 = tmp;
+    }
+    zx = (float)(x2-x1)/(float)(z2-z1);
+    zy = (float)(y2-y1)/(float)(z2-z1);
+    for (z = z1; z <= z2; z++) {
+      x = (int)(zx * (z - z1)) + x1;
+      y = (int)(zy * (z - z1)) + y1;
+      DrawCube.setRGBVoxel(x, y, z, red, green, blue);
+    }
+  }
+}
+
+// The whole line, every voxel rounded to nearest with halves towards the end
+// the major axis starts from, plotted through the range-checked setRGBVoxel()
+static void referenceLine(int x1, int y1, int z1, int x2, int y2, int z2) {
+  int dx = abs(x2 - x1), dy = abs(y2 - y1), dz = abs(z2 - z1);
+  int dmax, flip;
+
+  if ((dx >= dy) && (dx >= dz)) { dmax = dx; flip = (x1 > x2); }
+  else if (dy >= dz)            { dmax = dy; flip = (y1 > y2); }
+  else                          { dmax = dz; flip = (z1 > z2); }
+
+  if (flip) {
+    int tmp;
+    tmp = x2; x2 = x1; x1 = tmp;
+    tmp = y2; y2 = y1; y1 = tmp;
+    tmp = z2; z2 = z1; z1 = tmp;
+  }
+
+  for (int n = 0; n <= dmax; n++) {
+    double t = dmax ? (double)n / dmax : 0;
+    int x = x1 + (x2 >= x1 ? 1 : -1) * (int)ceil(t * dx - 0.5);
+    int y = y1 + (y2 >= y1 ? 1 : -1) * (int)ceil(t * dy - 0.5);
+    int z = z1 + (z2 >= z1 ? 1 : -1) * (int)ceil(t * dz - 0.5);
+    DrawCube.setRGBVoxel(x, y, z, 100, 0, 0);
+  }
+}
+
+// Records which voxels are lit and clears them again. Returns how many were lit.
+static int takeVoxels(VoxelSet set) {
+  int count = 0;
+  for (int x = 0; x < CUBE_SIZE; x++)
+    for (int y = 0; y < CUBE_SIZE; y++)
+      for (int z = 0; z < CUBE_SIZE; z++) {
+        set[x][y][z] = DrawCube.getRGBVoxelSpectrum(x, y, z) != 0;
+        if (set[x][y][z]) {
+          DrawCube.clearRGBVoxel(x, y, z);
+          count++;
+        }
+      }
+  return count;
+}
+
+static int sameVoxels(VoxelSet a, VoxelSet b) {
+  return memcmp(a, b, sizeof(VoxelSet)) == 0;
+}
+
+static double seconds(void) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main() {
+  const int N = CUBE_SIZE;
+  VoxelSet before, after, swapped;
+  long lines = 0, exactLines = 0, changed = 0, failed = 0;
+
+  DrawCube.clearAll();
+
+  for (int x1 = 0; x1 < N; x1++) for (int y1 = 0; y1 < N; y1++) for (int z1 = 0; z1 < N; z1++)
+  for (int x2 = 0; x2 < N; x2++) for (int y2 = 0; y2 < N; y2++) for (int z2 = 0; z2 < N; z2++) {
+    int dx = abs(x2 - x1), dy = abs(y2 - y1), dz = abs(z2 - z1);
+    int dmax = dx > dy ? (dx > dz ? dx : dz) : (dy > dz ? dy : dz);
+    int exact = (dx == 0 || dx == dmax) && (dy == 0 || dy == dmax) && (dz == 0 || dz == dmax);
+
+    oldLine(x1, y1, z1, x2, y2, z2, 100, 0, 0);
+    takeVoxels(before);
+    DrawCube.drawRGBLine(x1, y1, z1, x2, y2, z2, 100, 0, 0);
+    int count = takeVoxels(after);
+    DrawCube.drawRGBLine(x2, y2, z2, x1, y1, z1, 100, 0, 0);
+    takeVoxels(swapped);
+
+    lines++;
+    if (count != dmax + 1 || !sameVoxels(after, swapped)) {
+      failed++;
+    } else if (dmax == 0) {
+      // The old code drew nothing here
+    } else if (exact) {
+      exactLines++;
+      if (!sameVoxels(before, after)) failed++;
+    } else if (!sameVoxels(before, after)) {
+      changed++;
+    }
+  }
+
+  // Ends outside the cube, on both sides and far away
+  const int ends[] = { -N * 3, -2, -1, 0, 1, N / 2, N - 2, N - 1, N, N + 1, N * 4 };
+  const int numEnds = sizeof(ends) / sizeof(ends[0]);
+  long clipped = 0;
+
+  for (int a = 0; a < numEnds; a++) for (int b = 0; b < numEnds; b++) for (int c = 0; c < numEnds; c++)
+  for (int d = 0; d < numEnds; d += 2) for (int e = 1; e < numEnds; e += 2) for (int f = 0; f < numEnds; f++) {
+    referenceLine(ends[a], ends[b], ends[c], ends[d], ends[e], ends[f]);
+    takeVoxels(before);
+    DrawCube.drawRGBLine(ends[a], ends[b], ends[c], ends[d], ends[e], ends[f], 100, 0, 0);
+    takeVoxels(after);
+    clipped++;
+    if (!sameVoxels(before, after)) failed++;
+  }
+
+  printf("drawRGBLine: %ld lines in the cube, %ld axis-aligned or 45 degree all unchanged,"
+         " %ld others moved by rounding; %ld clipped lines\n", lines, exactLines, changed, clipped);
+
+  // Timing, both drawn into the same cube
+  for (int rep = 0; rep < 2; rep++) {
+    double t0 = seconds();
+    for (int x1 = 0; x1 < N; x1++) for (int y1 = 0; y1 < N; y1++) for (int z1 = 0; z1 < N; z1++)
+    for (int x2 = 0; x2 < N; x2++) for (int y2 = 0; y2 < N; y2++) for (int z2 = 0; z2 < N; z2++)
+      oldLine(x1, y1, z1, x2, y2, z2, 100, 0, 0);
+    double t1 = seconds();
+    for (int x1 = 0; x1 < N; x1++) for (int y1 = 0; y1 < N; y1++) for (int z1 = 0; z1 < N; z1++)
+    for (int x2 = 0; x2 < N; x2++) for (int y2 = 0; y2 < N; y2++) for (int z2 = 0; z2 < N; z2++)
+      DrawCube.drawRGBLine(x1, y1, z1, x2, y2, z2, 100, 0, 0);
+    double t2 = seconds();
+    if (rep) printf("  float %.1f ns per line, integer %.1f ns per line\n",
+                    (t1 - t0) / lines * 1e9, (t2 - t1) / lines * 1e9);
+  }
+
+  if (failed) printf("  %ld lines FAILED\n", failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/******************************************************************************
+Spectrum reduction test for Draw::reduceRGBToSpectrum() and
+Draw::scaleRGBToSpectrum().
+
+	reduceRGBToSpectrum() replaced float code (copied below as
+floatReduceRGBToSpectrum()). Every colour with no white part (one of the three
+0, the other two anything from 0 to 4095, in every order) and a few million
+with a white part are run through both. The integer version has to give the
+exact share every time: the second colour second * 4095 / (first + second)
+rounded down, the first the rest. The float version got that wrong on a few
+thousand inputs (the two didn't add up to 4095, or a colour came out a step
+low); those are the only inputs where the two may differ, and then by no more
+than one step in each colour. The number of them is printed.
+
+	scaleRGBToSpectrum() uses a Q16 fraction, (4095 << 16) / sum, where float
+code would use c * 4095.0 / sum. Every colour value against every sum it can
+be out of the spectrum with is checked: the Q16 result may come out one below
+the exact c * 4095 / sum rounded down, never more and never above it, and the
+three colours never add up to more than 4095. Build with
+
+	g++ -std=gnu++11 -O2 -IHostSim -ILEDCube HostSim/tests/draw_spectrum.cpp \
+		LEDCube/LEDCube.cpp LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include <Draw.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// reduceRGBToSpectrum() as it was before it moved to integers
+static int floatReduceRGBToSpectrum(int red, int green, int blue) {
+  float _tmp;
+  int _red, _green, _blue;
+
+    if ((red == green) && (green == blue)) {
+      _red = 0;
+      _green = 0;
+      _blue = 0;
+
+    } else if ((red <= green) && (red <= blue)) {
+        _red = 0;
+        green -= red;
+        blue -= red;
+
+        _tmp = green + blue;
+        _tmp = 4095.00 / _tmp;
+
+        _green = (int)(green *_tmp);
+        _blue = (int)(blue *_tmp);
+        if((_green + _blue) != 4095) _green++;
+
+    } else if ((green <= red) && (green <= blue)) {
+        _green = 0;
+        red -= green;
+        blue -= green;
+
+        _tmp = red + blue;
+        _tmp = 4095.00 / _tmp;
+
+        _red = (int)(red *_tmp);
+        _blue = (int)(blue *_tmp);
+        if((_red + _blue) != 4095) _blue++;
+
+    } else { // Blue is less than the others
+        _blue = 0;
+        red -= blue;
+        green -= blue;
+
+        _tmp = red + green;
+        _tmp = 4095.00 / _tmp;
+
+        _red = (int)(red *_tmp);
+        _green = (int)(green *_tmp);
+        if((_red + _green) != 4095) _red++;
+    }
+
+    return DrawCube.spectrumFromRGB(_red, _green, _blue);
+}
+
+// The exact reduction: white part out, then the second colour of each pair gets
+// its share of 4095 rounded down and the first the rest
+static int exactReduceRGBToSpectrum(int red, int green, int blue) {
+  int white = red < green ? (red < blue ? red : blue) : (green < blue ? green : blue);
+  int _red = red - white, _green = green - white, _blue = blue - white;
+
+  if ((red == green) && (green == blue)) return 0;
+
+  if (red == white) {
+    _blue = (int)((int64_t)_blue * 4095 / (_green + _blue));
+    _green = 4095 - _blue;
+  } else if (green == white) {
+    _red = (int)((int64_t)_red * 4095 / (_red + _blue));
+    _blue = 4095 - _red;
+  } else {
+    _green = (int)((int64_t)_green * 4095 / (_red + _green));
+    _red = 4095 - _green;
+  }
+
+  return DrawCube.spectrumFromRGB(_red, _green, _blue);
+}
+
+// Colour of a spectrum value, as Draw.cpp's spectrumToRGB()
+static void colourOf(int spectrum, int rgb[3]) {
+  spectrum--;
+  if (spectrum <= 4095)      { rgb[0] = 4095 - spectrum; rgb[1] = spectrum; rgb[2] = 0; }
+  else if (spectrum <= 8191) { rgb[0] = 0; rgb[1] = 8191 - spectrum; rgb[2] = spectrum - 4096; }
+  else                       { rgb[0] = spectrum - 8192; rgb[1] = 0; rgb[2] = 12287 - spectrum; }
+}
+
+// Whether two spectrum values are colours no more than one step apart in each
+// colour. Both ends of a ramp are the same colour under two spectrum values.
+static int withinOneStep(int a, int b) {
+  int ca[3], cb[3];
+  colourOf(a, ca);
+  colourOf(b, cb);
+  for (int i = 0; i < 3; i++) {
+    if (abs(ca[i] - cb[i]) > 1) return 0;
+  }
+  return 1;
+}
+
+static long reduceTested = 0, floatDiffers = 0, reduceFailed = 0;
+
+static void checkReduce(int red, int green, int blue) {
+  int spectrum = DrawCube.reduceRGBToSpectrum(red, green, blue);
+  int exact = exactReduceRGBToSpectrum(red, green, blue);
+  int old = floatReduceRGBToSpectrum(red, green, blue);
+
+  reduceTested++;
+  if (spectrum != exact) {
+    if (reduceFailed++ < 10) printf("  reduceRGBToSpectrum(%d, %d, %d) = %d, should be %d\n", red, green, blue, spectrum, exact);
+  } else if (spectrum != old) {
+    floatDiffers++;
+    if (!withinOneStep(spectrum, old)) {
+      if (reduceFailed++ < 10) printf("  reduceRGBToSpectrum(%d, %d, %d) = %d, float gave %d\n", red, green, blue, spectrum, old);
+    }
+  }
+}
+
+int main() {
+  for (int a = 0; a < 4096; a++) {
+    for (int b = 0; b < 4096; b++) {
+      checkReduce(0, a, b);
+      checkReduce(a, 0, b);
+      checkReduce(a, b, 0);
+    }
+  }
+
+  srand(21);
+  for (long i = 0; i < 4000000; i++) {
+    int white = rand() % 4096;
+    checkReduce(white + rand() % (4096 - white), white + rand() % (4096 - white), white + rand() % (4096 - white));
+  }
+
+  printf("reduceRGBToSpectrum: %ld colours, %ld differ from the float code where it was off\n",
+         reduceTested, floatDiffers);
+
+  long scaleTested = 0, scaleLow = 0, scaleFailed = 0;
+
+  // The scaled value of a colour only depends on it and the sum of all three
+  for (int sum = 4096; sum <= 3 * 4095; sum++) {
+    for (int c = (sum > 2 * 4095) ? sum - 2 * 4095 : 0; c <= 4095 && c <= sum; c++) {
+      int rest = sum - c;
+      int red = c, green = rest / 2, blue = rest - rest / 2;
+
+      DrawCube.scaleRGBToSpectrum(&red, &green, &blue);
+
+      int exact = (int)((int64_t)c * 4095 / sum);
+      scaleTested++;
+      if (red == exact - 1) scaleLow++;
+      if ((red != exact && red != exact - 1) || (red + green + blue > 4095)) {
+        if (scaleFailed++ < 10) printf("  scaleRGBToSpectrum(%d of %d) = %d, exact %d\n", c, sum, red, exact);
+      }
+    }
+  }
+
+  printf("scaleRGBToSpectrum: %ld colour and sum pairs, %ld one below the exact result\n",
+         scaleTested, scaleLow);
+
+  if (reduceFailed || scaleFailed) printf("  %ld reductions and %ld scales FAILED\n", reduceFailed, scaleFailed);
+  return (reduceFailed || scaleFailed) ? 1 : 0;
+}
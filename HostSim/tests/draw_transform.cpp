@@ -0,0 +1,111 @@
+/******************************************************************************
+Test and benchmark for Draw::transformCube().
+
+	Checks the sine table against sin(), that quarter turns about each axis give
+exactly what LEDCube::rotate90() gives (with and without smooth), that 0 and
+whole turns leave the cube as it was, and that a turn the other way does not
+match (so the sense is right). Then times one frame of transformCube() at a
+changing angle and scale, nearest voxel and smooth, on the host. Build with
+
+	g++ -std=gnu++11 -O2 -IHostSim -ILEDCube HostSim/tests/draw_transform.cpp \
+		LEDCube/LEDCube.cpp LEDCube/Draw.cpp HostSim/HostSim.cpp HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include <Draw.h>
+#include <Draw_sine.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+#define FRAMES  2000
+
+typedef uint16_t CubeData[CUBE_SIZE][NUM_CHANNELS];
+
+// Random values in every channel, the same each time
+static void fillCube(void) {
+  srand(5);
+  for (int l = 0; l < CUBE_SIZE; l++)
+    for (int c = 0; c < NUM_CHANNELS; c++)
+      Cube.set(l, c, rand() % 4096);
+}
+
+static void snapshot(CubeData data) {
+  for (int l = 0; l < CUBE_SIZE; l++)
+    for (int c = 0; c < NUM_CHANNELS; c++)
+      data[l][c] = Cube.get(l, c);
+}
+
+static double seconds(void) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main() {
+  static CubeData expected, transformed;
+  const int axes[3] = { CUBE_AXIS_X, CUBE_AXIS_Y, CUBE_AXIS_Z };
+  int failed = 0;
+
+  for (int d = 0; d <= 90; d++) {
+    if (draw_sineTable[d] != (int)lround(16384 * sin(d * M_PI / 180))) {
+      printf("  draw_sineTable[%d] = %d\n", d, draw_sineTable[d]);
+      failed++;
+    }
+  }
+
+  for (int smooth = 0; smooth < 2; smooth++) {
+    for (int i = 0; i < 3; i++) {
+      for (int turns = 1; turns <= 3; turns++) {
+        int angles[3] = { 0, 0, 0 };
+
+        fillCube();
+        Cube.rotate90(axes[i], turns);
+        snapshot(expected);
+
+        angles[i] = 90 * turns;
+        fillCube();
+        DrawCube.transformCube(angles[0], angles[1], angles[2], 100, smooth);
+        snapshot(transformed);
+        if (memcmp(expected, transformed, sizeof(CubeData))) {
+          printf("  %d degrees about axis %d (smooth %d) is not rotate90()\n", angles[i], i, smooth);
+          failed++;
+        }
+
+        // The other way round only matches for a half turn
+        angles[i] = -90 * turns;
+        fillCube();
+        DrawCube.transformCube(angles[0], angles[1], angles[2], 100, smooth);
+        snapshot(transformed);
+        if ((turns != 2) == !memcmp(expected, transformed, sizeof(CubeData))) {
+          printf("  %d degrees about axis %d (smooth %d) turns the wrong way\n", angles[i], i, smooth);
+          failed++;
+        }
+      }
+    }
+
+    fillCube();
+    snapshot(expected);
+    DrawCube.transformCube(0, 0, 0, 100, smooth);
+    DrawCube.transformCube(360, -720, 1080, 100, smooth);
+    snapshot(transformed);
+    if (memcmp(expected, transformed, sizeof(CubeData))) {
+      printf("  whole turns (smooth %d) change the cube\n", smooth);
+      failed++;
+    }
+  }
+
+  printf("transformCube: %s\n", failed ? "FAILED" : "quarter turns match rotate90(), whole turns change nothing");
+
+  for (int smooth = 0; smooth < 2; smooth++) {
+    fillCube();
+    double start = seconds();
+    for (int f = 0; f < FRAMES; f++) {
+      DrawCube.transformCube(f, 2 * f, 3 * f, 80 + f % 40, smooth);
+    }
+    printf("  %s: %.1f us per frame\n", smooth ? "smooth" : "nearest voxel", (seconds() - start) / FRAMES * 1e6);
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Builds and runs the HostSim test programs in every configuration they cover.
+# Run from anywhere; stops at the first failure.
+
+set -e
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+OUT=${TMPDIR:-/tmp}/hostsim_tests
+mkdir -p "$OUT"
+CXX=${CXX:-g++}
+CXXFLAGS="-std=gnu++11 -O2 -I$ROOT/HostSim"
+SIM="$ROOT/HostSim/HostSim.cpp $ROOT/HostSim/Tlc5940Sim.cpp"
+
+tlc_test() {
+	name=$1; shift
+	$CXX $CXXFLAGS "$@" -I"$ROOT/Tlc5940" "$ROOT/HostSim/tests/$name.cpp" \
+		"$ROOT/Tlc5940/Tlc5940.cpp" $SIM -o "$OUT/$name"
+	"$OUT/$name"
+}
+
+cube_test() {
+	name=$1; shift
+	$CXX $CXXFLAGS "$@" -I"$ROOT/LEDCube" "$ROOT/HostSim/tests/$name.cpp" \
+		"$ROOT/LEDCube/LEDCube.cpp" "$ROOT/LEDCube/Draw.cpp" $SIM -o "$OUT/$name"
+	"$OUT/$name"
+}
+
+for mode in TLC_BITBANG TLC_SPI TLC_SPI_DMA; do
+	tlc_test tlc_transfer -DDATA_TRANSFER_MODE=$mode
+	tlc_test tlc_transfer -DDATA_TRANSFER_MODE=$mode -DNUM_TLCS=3
+done
+tlc_test tlc_gamma -DTLC_GAMMA_ENABLED=1
+tlc_test tlc_gamma -DTLC_GAMMA_ENABLED=1 -DTLC_GAMMA=1.8 -DNUM_TLCS=3
+
+cube_test draw_line
+cube_test draw_limit
+cube_test draw_limit -DLIMIT_CURRENT=0
+cube_test draw_spectrum
+cube_test draw_transform
+cube_test draw_transform -DCUBE_WORKING_BUFFER=1
+cube_test cube_permute
+cube_test cube_permute -DCUBE_WORKING_BUFFER=1
+for mode in TLC_SPI TLC_SPI_DMA; do
+	cube_test cube_transfer -DDATA_TRANSFER_MODE=$mode
+	cube_test cube_transfer -DDATA_TRANSFER_MODE=$mode -DCUBE_SPI_CHAINS=2
+done
+cube_test cube_transfer -DDATA_TRANSFER_MODE=TLC_BITBANG
+for chains in 1 2 4 6 12; do
+	cube_test cube_transfer -DDATA_TRANSFER_MODE=TLC_PARALLEL -DCUBE_PARALLEL_CHAINS=$chains
+done
+cube_test cube_buffer -DCUBE_DOUBLE_BUFFER=1
+cube_test cube_buffer -DCUBE_DOUBLE_BUFFER=1 -DCUBE_WORKING_BUFFER=1
+cube_test cube_buffer -DCUBE_DOUBLE_BUFFER=1 -DDATA_TRANSFER_MODE=TLC_SPI
+cube_test cube_budget -DCUBE_WORKING_BUFFER=1 -DCUBE_LAYER_BUDGET_MA=1000 -DCUBE_TLC_BUDGET_MA=150
+cube_test cube_budget -DCUBE_WORKING_BUFFER=1 -DCUBE_LAYER_BUDGET_MA=500
+cube_test cube_budget -DCUBE_WORKING_BUFFER=1 -DCUBE_TLC_BUDGET_MA=100
+cube_test cube_gamma -DCUBE_GAMMA_ENABLED=1 -DCUBE_WORKING_BUFFER=1
+cube_test cube_gamma -DCUBE_GAMMA_ENABLED=1 -DCUBE_WORKING_BUFFER=1 -DCUBE_DOUBLE_BUFFER=1 -DCUBE_GAMMA=2.5
+cube_test cube_refresh -DCUBE_AUTO_REFRESH=1
+cube_test cube_refresh -DCUBE_AUTO_REFRESH=1 -DCUBE_DOUBLE_BUFFER=1
+cube_test cube_refresh -DCUBE_DOUBLE_BUFFER=1 -DCUBE_WORKING_BUFFER=1 -DCUBE_SPI_CHAINS=2
@@ -0,0 +1,100 @@
+/******************************************************************************
+Gamma test for the Tlc5940 library (TLC_GAMMA_ENABLED).
+
+	Checks every entry of the compiler-built TLC_GAMMA_TABLE() for gammas 1.0,
+1.8, 2.2, 2.5 and 3.0 against round(4095 * (v / 4095) ^ gamma) worked out with
+pow(), and prints the largest difference. Then sets every channel at a few
+brightness levels (setBrightness()), with set() and setRange(), and checks that
+the simulated chain latched the gamma corrected value of each. Build with
+
+	g++ -std=gnu++11 -O2 -DTLC_GAMMA_ENABLED=1 -IHostSim -ITlc5940 \
+		HostSim/tests/tlc_gamma.cpp Tlc5940/Tlc5940.cpp HostSim/HostSim.cpp \
+		HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if any check fails.
+******************************************************************************/
+
+#include <Tlc5940.h>
+#include <Tlc5940Sim.h>
+#include <tlc_gamma.h>
+#include <math.h>
+#include <stdio.h>
+
+#if !TLC_GAMMA_ENABLED
+	#error "Build with -DTLC_GAMMA_ENABLED=1"
+#endif
+
+static unsigned int seed = 12345;
+
+static int nextValue(int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % range;
+}
+
+static int expected(double gamma, int v)
+{
+	return (int)floor(4095.0 * pow(v / 4095.0, gamma) + 0.5);
+}
+
+// Number of entries of table that aren't the pow() result
+static int checkTable(const uint16_t *table, double gamma)
+{
+	int wrong = 0, worst = 0;
+
+	for (int v = 0; v < 4096; v++) {
+		int diff = abs(table[v] - expected(gamma, v));
+		if (diff) wrong++;
+		if (diff > worst) worst = diff;
+	}
+	printf("  gamma %.1f: %d of 4096 entries differ from pow(), by at most %d\n", gamma, wrong, worst);
+
+	return wrong;
+}
+
+int main()
+{
+	Tlc5940Sim chip(NUM_TLCS, TLC5940SIM_TLC_PINS);
+	int channels = NUM_TLCS * 16;
+	int bad = 0;
+
+	printf("TLC_GAMMA_TABLE() against pow():\n");
+	bad += checkTable(TLC_GAMMA_TABLE(1.0), 1.0);
+	bad += checkTable(TLC_GAMMA_TABLE(1.8), 1.8);
+	bad += checkTable(TLC_GAMMA_TABLE(2.2), 2.2);
+	bad += checkTable(TLC_GAMMA_TABLE(2.5), 2.5);
+	bad += checkTable(TLC_GAMMA_TABLE(3.0), 3.0);
+
+	Tlc.init(0);
+
+	static const int brightness[] = { 255, 200, 128, 1, 0 };
+	int latchedWrong = 0;
+
+	for (unsigned int b = 0; b < sizeof(brightness) / sizeof(brightness[0]); b++) {
+		Tlc.setBrightness(brightness[b]);
+
+		uint16_t values[NUM_TLCS * 16];
+		for (int c = 0; c < channels; c++) values[c] = nextValue(4096);
+		values[0] = 4095;
+		values[1] = 0;
+
+		// Half through set(), half through setRange()'s whole groups
+		for (int c = 0; c < channels / 2; c++) Tlc.set(c, values[c]);
+		Tlc.setRange(channels / 2, values + channels / 2, channels - channels / 2);
+
+		while (Tlc.update()) SimIdle();
+		while (Tlc.updateInProgress()) SimIdle();
+
+		for (int c = 0; c < channels; c++) {
+			int scaled = (values[c] * (brightness[b] + 1)) >> 8;
+			if (chip.gs(c) != expected(TLC_GAMMA, scaled)) latchedWrong++;
+		}
+	}
+	bad += latchedWrong;
+
+	printf("TLC_GAMMA %.1f, %d TLCs: %s\n", (double)TLC_GAMMA, NUM_TLCS,
+	       bad ? "FAILED" : "tables match pow(), every brightness latched corrected");
+	if (latchedWrong) printf("  %d channels latched wrong\n", latchedWrong);
+
+	return bad ? 1 : 0;
+}
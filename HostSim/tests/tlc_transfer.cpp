@@ -0,0 +1,97 @@
+/******************************************************************************
+Transfer test for the Tlc5940 library.
+
+	Sends frames of pseudo-random grayscale data and some dot correction through
+whichever DATA_TRANSFER_MODE the library is built with, checks that the
+simulated TLC5940 chain latched exactly what was set, and reports what one
+frame costs: cycles update() blocks for, cycles until the data is latched
+(mostly the wait for the end of the current GSCLK period) and port register
+writes, which is the cost of TLC_BITBANG since register writes take no
+simulated time (see HostSim.h). Build it once per mode, e.g.
+
+	g++ -std=gnu++11 -DDATA_TRANSFER_MODE=TLC_BITBANG -IHostSim -ITlc5940 \
+		HostSim/tests/tlc_transfer.cpp Tlc5940/Tlc5940.cpp HostSim/HostSim.cpp \
+		HostSim/Tlc5940Sim.cpp
+
+or run HostSim/tests/run_tests.sh. Exits with 1 if anything was latched wrong.
+******************************************************************************/
+
+#include <Tlc5940.h>
+#include <Tlc5940Sim.h>
+#include <stdio.h>
+
+#define FRAMES	16
+
+static const char* modeName(void)
+{
+#if DATA_TRANSFER_MODE == TLC_BITBANG
+	return "TLC_BITBANG";
+#elif DATA_TRANSFER_MODE == TLC_SPI
+	return "TLC_SPI";
+#else
+	return "TLC_SPI_DMA";
+#endif
+}
+
+static unsigned int seed = 12345;
+
+static int nextValue(int range)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % range;
+}
+
+int main()
+{
+	Tlc5940Sim chip(NUM_TLCS, TLC5940SIM_TLC_PINS);
+	int channels = NUM_TLCS * 16;
+	int bits = NUM_TLCS * 192;
+	int bad = 0;
+
+	Tlc.init(0);
+
+#if VPRG_ENABLED
+	for (int c = 0; c < channels; c++) {
+		Tlc.setDC(c, nextValue(64));
+	}
+	while (Tlc.updateDC()) SimIdle();
+	while (Tlc.updateInProgress()) SimIdle();
+
+	for (int c = 0; c < channels; c++) {
+		if (chip.dc(c) != Tlc.getDC(c)) bad++;
+	}
+#endif
+
+	uint64_t latchCycles = 0, blockedCycles = 0;
+	unsigned long portWrites = 0;
+
+	for (int frame = 0; frame < FRAMES; frame++) {
+		for (int c = 0; c < channels; c++) {
+			Tlc.set(c, nextValue(4096));
+		}
+
+		unsigned long writes = SimPortWrites();
+		uint64_t start = SimCycles();
+
+		while (Tlc.update()) SimIdle();
+
+		blockedCycles += SimCycles() - start;
+		portWrites += SimPortWrites() - writes;
+
+		while (Tlc.updateInProgress()) SimIdle();
+		latchCycles += chip.lastLatchCycle() - start;
+
+		for (int c = 0; c < channels; c++) {
+			if (chip.gs(c) != Tlc.get(c)) bad++;
+		}
+	}
+
+	printf("%s, %d TLCs: %s\n", modeName(), NUM_TLCS, bad ? "FAILED" : "ok");
+	printf("  update() blocked %.0f cycles, data latched %.0f cycles after update()\n",
+		(double)blockedCycles / FRAMES, (double)latchCycles / FRAMES);
+	printf("  %.0f port register writes per frame (%.2f per bit)\n",
+		(double)portWrites / FRAMES, (double)portWrites / FRAMES / bits);
+	if (bad) printf("  %d channels latched wrong\n", bad);
+
+	return bad ? 1 : 0;
+}
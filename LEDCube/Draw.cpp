@@ -20,9 +20,54 @@ http://playground.arduino.cc/learning/TLC5940
 ******************************************************************************/
 
 #include <Draw.h>
+#include <Draw_sine.h>
+#include <string.h>
+
+#if RGB_LEDS
+// Marks a voxel of cube_SpectrumData whose colour was changed behind Draw's back
+#define SPECTRUM_UNKNOWN  0xFFFF
+
+// Spectrum of every voxel (1 to getMaxSpectrum(), 0 for off), kept up to date by
+// the Draw functions so the spectrum effects never have to read the colours back
+// out of the packed data. Voxels drawn with a plain colour hold spectrumFromRGB()
+// of it, those moved in from outside the cube SPECTRUM_UNKNOWN.
+uint16_t cube_SpectrumData[CUBE_SIZE][RGB_CHANNELS];
+
+// Sets the spectrum of every voxel in the box x..x2, y..y2, z..z2 (already in the cube)
+static void setSpectrumBox(int x, int y, int z, int x2, int y2, int z2, int spectrum) {
+  for(int _z = z; _z <= z2; _z++) {
+    for(int _x = x; _x <= x2; _x++) {
+      for(int _y = y; _y <= y2; _y++) {
+        cube_SpectrumData[_z][_x * CUBE_SIZE + _y] = spectrum;
+      }
+    }
+  }
+}
+
+// Moves count spectrum values by shift places (at most RGB_CHANNELS), the same way
+// LEDCube::shiftChannels() moves the channels. Without wrap the ones that come in
+// are SPECTRUM_UNKNOWN.
+static void shiftSpectrum(uint16_t *spectrum, int count, int shift, int wrap) {
+  uint16_t out[RGB_CHANNELS];
+  int n = (shift > 0) ? shift : -shift;
+
+  if (shift > 0) {
+    memcpy(out, spectrum + count - n, n * sizeof(uint16_t));
+    memmove(spectrum + n, spectrum, (count - n) * sizeof(uint16_t));
+    for(int i = 0; i < n; i++) spectrum[i] = wrap ? out[i] : SPECTRUM_UNKNOWN;
+  } else {
+    memcpy(out, spectrum, n * sizeof(uint16_t));
+    memmove(spectrum, spectrum + n, (count - n) * sizeof(uint16_t));
+    for(int i = 0; i < n; i++) spectrum[count - n + i] = wrap ? out[i] : SPECTRUM_UNKNOWN;
+  }
+}
+#endif
 
 void Draw::clearAll(void) {
 	 Cube.clearAll();
+#if RGB_LEDS
+	 memset(cube_SpectrumData, 0, sizeof(cube_SpectrumData));
+#endif
 }
 
 unsigned char Draw::intensityOutOfRange(int intensity) {
@@ -49,131 +94,312 @@ unsigned char Draw::coordOutOfRange(int x, int y, int z) {
 
 // Clears all voxels along a Y/Z plane at a given point on axis X
 void Draw::clearPlaneX(int x) {
-  if (x >= 0 && x < CUBE_SIZE) {
-    for(int z = 0; z < CUBE_SIZE; z++) {
-          for (int c = (x * CUBE_SIZE); c < ((x * CUBE_SIZE) + CUBE_SIZE); c++) {
-            Cube.setRGB(z, c, 0, 0, 0); 
-          }
-     }
-  }
+  setRGBPlaneX(x, 0, 0, 0);
 }
 
 // Clears all voxels along a X/Z plane at a given point on axis Y
 void Draw::clearPlaneY(int y) {
-  if (y >= 0 && y < CUBE_SIZE) {
-    for(int z = 0; z < CUBE_SIZE; z++) {
-          for (int c = y; c < RGB_CHANNELS; c += CUBE_SIZE) {
-            Cube.setRGB(z, c, 0, 0, 0); 
-          }
-     }
-  }
+  setRGBPlaneY(y, 0, 0, 0);
 }
 
 // Clears all voxels along a X/Y plane at a given point on axis Z
 void Draw::clearPlaneZ(int z) {
   if (z >= 0 && z < CUBE_SIZE) {
-      for (int c = 0; c < RGB_CHANNELS; c++) {
-        Cube.setRGB(z, c, 0, 0, 0); 
-      }
+      Cube.setAllRGBOnLayer(z, 0, 0, 0);
+#if RGB_LEDS
+      memset(cube_SpectrumData[z], 0, sizeof(cube_SpectrumData[z]));
+#endif
   }
 }
 
 
+// Each X plane is a run of CUBE_SIZE * LED_SIZE channels on every layer, so
+// moving the cube over X moves the channels of each layer by one run
+static void shiftLayersX(int direction, int count, int wrap) {
+  int shift = (direction > 0) ? CUBE_SIZE * LED_SIZE : -(CUBE_SIZE * LED_SIZE);
+
+  for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
+    Cube.shiftChannels(_layer, 0, count, shift, wrap);
+#if RGB_LEDS
+    shiftSpectrum(cube_SpectrumData[_layer], CUBE_SIZE * CUBE_SIZE, shift / LED_SIZE, wrap);
+#endif
+  }
+}
+
+// Each row of CUBE_SIZE * LED_SIZE channels runs along Y, so moving the cube
+// over Y moves the channels of every row by one LED
+static void shiftRowsY(int direction, int wrap) {
+  int shift = (direction > 0) ? LED_SIZE : -LED_SIZE;
+
+  for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
+    for(int _row = 0; _row + (CUBE_SIZE * LED_SIZE) <= NUM_CHANNELS; _row += CUBE_SIZE * LED_SIZE) {
+      Cube.shiftChannels(_layer, _row, CUBE_SIZE * LED_SIZE, shift, wrap);
+    }
+#if RGB_LEDS
+    for(int _x = 0; _x < CUBE_SIZE; _x++) {
+      shiftSpectrum(cube_SpectrumData[_layer] + _x * CUBE_SIZE, CUBE_SIZE, shift / LED_SIZE, wrap);
+    }
+#endif
+  }
+}
+
 // Shifts entire contents of cube over X axis
 void Draw::shiftCubeX(int direction) {
   if(direction == 0) return;
 
-  // Move in positive direction
-  if(direction > 0) {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-        for(int _channel = (NUM_CHANNELS - 1); _channel >= 0; _channel--) {
-          if(_channel > ((CUBE_SIZE * LED_SIZE) - 1)) {
-            Cube.set(_layer, _channel, Cube.get(_layer, (_channel - (CUBE_SIZE * LED_SIZE))));
-          } else {
-            // Clear the final X Plane
-            Cube.set(_layer, _channel, 0);
-          } 
-        }
-      }
-  // Move in negative direction
-  } else {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-        for(int _channel = 0; _channel < NUM_CHANNELS; _channel++) {
-          if(_channel < (NUM_CHANNELS - (CUBE_SIZE * LED_SIZE))) {
-            Cube.set(_layer, _channel, Cube.get(_layer, (_channel + (CUBE_SIZE * LED_SIZE))));
-          } else {
-            // Clear the final X Plane
-            Cube.set(_layer, _channel, 0);
-          }
-        }
-      }
-  }
+  shiftLayersX(direction, NUM_CHANNELS, 0);
+}
+
+// Rotates entire contents of cube over X axis by one plane; the plane that
+// falls off one end comes back in at the other
+void Draw::rotateCubeX(int direction) {
+  if(direction == 0) return;
+
+  shiftLayersX(direction, CUBE_SIZE * CUBE_SIZE * LED_SIZE, 1);
 }
 
 // Shifts entire contents of cube over Y axis
 void Draw::shiftCubeY(int direction) {
   if(direction == 0) return;
 
+  shiftRowsY(direction, 0);
+}
+
+// Rotates entire contents of cube over Y axis by one plane
+void Draw::rotateCubeY(int direction) {
+  if(direction == 0) return;
+
+  shiftRowsY(direction, 1);
+}
+
+// Shifts entire contents of cube over Z axis. The layers are only renumbered
+// (see LEDCube::rotateLayers()), so this costs one clearLayer() for the layer
+// that comes in empty.
+void Draw::shiftCubeZ(int direction) {
+  if(direction == 0) return;
+
   // Move in positive direction
   if(direction > 0) {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-        for(int _channel = NUM_CHANNELS - 1; _channel >= 0; _channel --) {
-          if(((_channel - (LED_SIZE - 1)) % (CUBE_SIZE * LED_SIZE)) == 0) {
-            for(int i = 0; i < LED_SIZE; i++) {
-              Cube.set(_layer, _channel, 0); // Clear final Y Layer
-              _channel--;
-            } 
-            _channel++;
-          } else {
-            Cube.set(_layer, _channel, Cube.get(_layer, _channel - (1 * LED_SIZE)));
-          } 
-        }
-      }
+      Cube.rotateLayers(1);
+      Cube.clearLayer(0); // Clear final Z Layer
+#if RGB_LEDS
+      memmove(cube_SpectrumData[1], cube_SpectrumData[0], (CUBE_SIZE - 1) * sizeof(cube_SpectrumData[0]));
+      memset(cube_SpectrumData[0], 0, sizeof(cube_SpectrumData[0]));
+#endif
   // Move in negative direction
   } else {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-        for(int _channel = 0; _channel < NUM_CHANNELS; _channel ++) {
-          if(((_channel + LED_SIZE) % (CUBE_SIZE * LED_SIZE)) == 0) {
-            for(int i = 0; i < LED_SIZE; i++) {
-              Cube.set(_layer, _channel, 0); // Clear final Y Layer
-              _channel++;
-            } 
-            _channel--;
-          } else {
-            Cube.set(_layer, _channel, Cube.get(_layer, _channel + (1 * LED_SIZE)));
-          }
-        }
-      }
+      Cube.rotateLayers(-1);
+      Cube.clearLayer(CUBE_SIZE - 1); // Clear final Z Layer
+#if RGB_LEDS
+      memmove(cube_SpectrumData[0], cube_SpectrumData[1], (CUBE_SIZE - 1) * sizeof(cube_SpectrumData[0]));
+      memset(cube_SpectrumData[CUBE_SIZE - 1], 0, sizeof(cube_SpectrumData[0]));
+#endif
   }
 }
 
-// Shifts entire contents of cube over Z axis
-void Draw::shiftCubeZ(int direction) {
+// Rotates entire contents of cube over Z axis by one layer; the layer that
+// falls off one end comes back in at the other
+void Draw::rotateCubeZ(int direction) {
   if(direction == 0) return;
 
-  // Move in positive direction
-  if(direction > 0) {
-      for(int _layer = CUBE_SIZE - 1; _layer >= 0; _layer--) {
-        for(int _channel = 0; _channel < NUM_CHANNELS; _channel ++) {
-          if(_layer == 0) {
-            Cube.set(_layer, _channel, 0); // Clear final Z Layer 
-          } else {
-            Cube.set(_layer, _channel, Cube.get((_layer - 1), _channel));
-          }
+  Cube.rotateLayers((direction > 0) ? 1 : -1);
+#if RGB_LEDS
+  shiftSpectrum(cube_SpectrumData[0], CUBE_SIZE * RGB_CHANNELS, (direction > 0) ? RGB_CHANNELS : -RGB_CHANNELS, 1);
+#endif
+}
+
+
+#if RGB_LEDS
+// Moves every voxel's spectrum the way LEDCube's rotate90(), mirror() and
+// transpose() move the voxels: voxel c takes the spectrum of the voxel whose
+// coordinate i is c[from[i]], counted from the far side if flip[i] is set.
+static void permuteSpectrum(const int from[3], const int flip[3]) {
+  static uint16_t source[CUBE_SIZE][RGB_CHANNELS];
+  int c[3];
+
+  memcpy(source, cube_SpectrumData, sizeof(source));
+
+  for(c[2] = 0; c[2] < CUBE_SIZE; c[2]++) {
+    for(c[0] = 0; c[0] < CUBE_SIZE; c[0]++) {
+      for(c[1] = 0; c[1] < CUBE_SIZE; c[1]++) {
+        int s[3];
+        for(int i = 0; i < 3; i++) {
+          s[i] = flip[i] ? (CUBE_SIZE - 1) - c[from[i]] : c[from[i]];
         }
+        cube_SpectrumData[c[2]][c[0] * CUBE_SIZE + c[1]] = source[s[2]][s[0] * CUBE_SIZE + s[1]];
       }
-  // Move in negative direction
-  } else {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-        for(int _channel = 0; _channel < NUM_CHANNELS; _channel ++) {
-          if(_layer == (CUBE_SIZE - 1)) {
-            Cube.set(_layer, _channel, 0); // Clear final Z Layer 
-          } else {
-            Cube.set(_layer, _channel, Cube.get((_layer + 1), _channel));
+    }
+  }
+}
+#endif
+
+// Turns the cube by quarter turns about an axis (see LEDCube::rotate90()),
+// spectrum and all
+void Draw::rotateCube90(int axis, int turns) {
+  if ((axis < CUBE_AXIS_X) || (axis > CUBE_AXIS_Z)) return;
+
+  Cube.rotate90(axis, turns);
+#if RGB_LEDS
+  // Where each voxel comes from for one quarter turn, as in LEDCube::rotate90()
+  static const int from[3][3] = { { 0, 2, 1 }, { 2, 1, 0 }, { 1, 0, 2 } };
+  static const int flip[3][3] = { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } };
+
+  turns %= 4;
+  if (turns < 0) turns += 4;
+  for(int i = 0; i < turns; i++) {
+    permuteSpectrum(from[axis], flip[axis]);
+  }
+#endif
+}
+
+// Mirrors the cube along an axis (see LEDCube::mirror()), spectrum and all
+void Draw::mirrorCube(int axis) {
+  if ((axis < CUBE_AXIS_X) || (axis > CUBE_AXIS_Z)) return;
+
+  Cube.mirror(axis);
+#if RGB_LEDS
+  static const int from[3] = { 0, 1, 2 };
+  int flip[3] = { 0, 0, 0 };
+
+  flip[axis] = 1;
+  permuteSpectrum(from, flip);
+#endif
+}
+
+// Swaps X and Y (see LEDCube::transpose()), spectrum and all
+void Draw::transposeCube(void) {
+  Cube.transpose();
+#if RGB_LEDS
+  static const int from[3] = { 1, 0, 2 };
+  static const int flip[3] = { 0, 0, 0 };
+
+  permuteSpectrum(from, flip);
+#endif
+}
+
+
+// Sine of an angle in degrees, 16384 = 1 (see Draw_sine.h)
+static int sineQ14(int degrees) {
+  degrees %= 360;
+  if (degrees < 0) degrees += 360;
+
+  if (degrees <= 90)  return draw_sineTable[degrees];
+  if (degrees <= 180) return draw_sineTable[180 - degrees];
+  if (degrees <= 270) return -draw_sineTable[degrees - 180];
+  return -draw_sineTable[360 - degrees];
+}
+
+// Q14 product of two 3x3 Q14 matrices
+static void multiplyQ14(const int a[3][3], const int b[3][3], int out[3][3]) {
+  for(int i = 0; i < 3; i++) {
+    for(int j = 0; j < 3; j++) {
+      out[i][j] = (a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + 8192) >> 14;
+    }
+  }
+}
+
+// Copy of the frame transformCube() maps the new one from. Costs
+// CUBE_SIZE * CUBE_SIZE * CUBE_SIZE * LED_SIZE * 2 bytes of RAM if it is used.
+static uint16_t transformSource[CUBE_SIZE][CUBE_SIZE * CUBE_SIZE * LED_SIZE];
+
+// Colour k of voxel (x, y, z) of transformSource, off outside the cube
+static inline int sourceValue(int x, int y, int z, int k) {
+  if ((unsigned)x >= CUBE_SIZE || (unsigned)y >= CUBE_SIZE || (unsigned)z >= CUBE_SIZE) return 0;
+
+  return transformSource[z][(x * CUBE_SIZE + y) * LED_SIZE + k];
+}
+
+// Linear blend from a to b, f = 0 to 16384
+static inline int lerpQ14(int a, int b, int f) {
+  return a + (((b - a) * f + 8192) >> 14);
+}
+
+// Rotates the contents of the whole cube about its centre, angleX degrees about
+// X, then angleY about Y, then angleZ about Z (anticlockwise looking down the axis
+// from its far end, like LEDCube::rotate90()), and scales them by scale percent.
+// The cube is read into a copy once, and every voxel of the new frame is mapped
+// back into it through the inverse rotation, a Q14 matrix built from the sine
+// table, so each voxel is a few adds. It takes the colour of the nearest voxel,
+// or if smooth is set a trilinear blend of the eight around it. Voxels that map
+// to outside the cube come out off. Each layer goes back with one setRange().
+void Draw::transformCube(int angleX, int angleY, int angleZ, int scale, int smooth) {
+  if (scale <= 0) return;
+
+  int sx = sineQ14(angleX), cx = sineQ14(angleX + 90);
+  int sy = sineQ14(angleY), cy = sineQ14(angleY + 90);
+  int sz = sineQ14(angleZ), cz = sineQ14(angleZ + 90);
+
+  const int rx[3][3] = { { 16384, 0, 0 }, { 0, cx, -sx }, { 0, sx, cx } };
+  const int ry[3][3] = { { cy, 0, sy }, { 0, 16384, 0 }, { -sy, 0, cy } };
+  const int rz[3][3] = { { cz, -sz, 0 }, { sz, cz, 0 }, { 0, 0, 16384 } };
+  int ryx[3][3], r[3][3];
+
+  multiplyQ14(ry, rx, ryx);
+  multiplyQ14(rz, ryx, r);
+
+  // The inverse of a rotation is its transpose; shrinking it by the scale maps
+  // the new frame back into the old one
+  int m[3][3];
+  for(int i = 0; i < 3; i++) {
+    for(int j = 0; j < 3; j++) {
+      m[i][j] = r[j][i] * 100 / scale;
+    }
+  }
+
+  for(int _z = 0; _z < CUBE_SIZE; _z++) {
+    Cube.getRange(_z, 0, transformSource[_z], CUBE_SIZE * CUBE_SIZE * LED_SIZE);
+  }
+
+  // Coordinates are in half voxels from the centre, 2 * n - (CUBE_SIZE - 1), so
+  // the centre of an even cube is a whole number. Stepping y adds 2 * m[i][1].
+  for(int _z = 0; _z < CUBE_SIZE; _z++) {
+    uint16_t _values[CUBE_SIZE * CUBE_SIZE * LED_SIZE];
+    uint16_t *_out = _values;
+    int dz = 2 * _z - (CUBE_SIZE - 1);
+
+    for(int _x = 0; _x < CUBE_SIZE; _x++) {
+      int dx = 2 * _x - (CUBE_SIZE - 1);
+      int dy = -(CUBE_SIZE - 1);
+      int p[3];
+
+      // Q14 position in the old frame of voxel y = 0, in whole voxels from voxel 0
+      for(int i = 0; i < 3; i++) {
+        p[i] = m[i][0] * dx + m[i][1] * dy + m[i][2] * dz + ((CUBE_SIZE - 1) << 14);
+      }
+
+      for(int _y = 0; _y < CUBE_SIZE; _y++) {
+        int px = p[0] >> 1, py = p[1] >> 1, pz = p[2] >> 1;
+
+        if (!smooth) {
+          int nx = (px + 8192) >> 14, ny = (py + 8192) >> 14, nz = (pz + 8192) >> 14;
+          for(int k = 0; k < LED_SIZE; k++) {
+            *_out++ = sourceValue(nx, ny, nz, k);
+          }
+        } else {
+          int x0 = px >> 14, y0 = py >> 14, z0 = pz >> 14;
+          int fx = px & 0x3FFF, fy = py & 0x3FFF, fz = pz & 0x3FFF;
+          for(int k = 0; k < LED_SIZE; k++) {
+            int c00 = lerpQ14(sourceValue(x0, y0, z0, k),         sourceValue(x0 + 1, y0, z0, k), fx);
+            int c10 = lerpQ14(sourceValue(x0, y0 + 1, z0, k),     sourceValue(x0 + 1, y0 + 1, z0, k), fx);
+            int c01 = lerpQ14(sourceValue(x0, y0, z0 + 1, k),     sourceValue(x0 + 1, y0, z0 + 1, k), fx);
+            int c11 = lerpQ14(sourceValue(x0, y0 + 1, z0 + 1, k), sourceValue(x0 + 1, y0 + 1, z0 + 1, k), fx);
+            *_out++ = lerpQ14(lerpQ14(c00, c10, fy), lerpQ14(c01, c11, fy), fz);
           }
         }
+
+        for(int i = 0; i < 3; i++) {
+          p[i] += 2 * m[i][1];
+        }
       }
+    }
+
+    Cube.setRange(_z, 0, _values, CUBE_SIZE * CUBE_SIZE * LED_SIZE);
   }
+
+#if RGB_LEDS
+  // The colours have all moved or been blended
+  resyncRGBSpectrum();
+#endif
 }
 
 
@@ -181,25 +407,50 @@ void Draw::shiftCubeZ(int direction) {
 // RGB LED Functions:
 #if RGB_LEDS
 
-int cube_SpectrumData[CUBE_SIZE][RGB_CHANNELS];
+// Colour of a spectrum value (1 to 12288). The spectrum is three straight ramps
+// (red to green, green to blue, blue to red), so it is worked out in two compares
+// rather than kept in a 12288 entry table.
+static void spectrumToRGB(int spectrum, int *red, int *green, int *blue) {
+    spectrum--;
+
+    if (spectrum <= 4095)
+    {
+      *red = 4095 - spectrum;            // red goes from on to off
+      *green = spectrum;                 // green goes from off to on
+      *blue = 0;                         // blue is always off
+    }
+    else if (spectrum <= 8191)  
+    {
+      *red = 0;                          // red is always off
+      *green = 4095 - (spectrum - 4096); // green on to off
+      *blue = (spectrum - 4096);         // blue off to on
+    }
+    else // spectrum > 8191
+    {
+      *red = (spectrum - 8192);         // red off to on
+      *green = 0;                       // green is always off
+      *blue = 4095 - (spectrum - 8192); // blue on to off
+    }
+}
+
+// Wraps any spectrum value around into 1 to 12288
+static int wrapSpectrum(int spectrum) {
+    spectrum = (spectrum - 1) % 12288;
+    if (spectrum < 0) spectrum += 12288;
+
+    return spectrum + 1;
+}
 
 // Set a single voxel to ON
 void Draw::setRGBVoxel(int x, int y, int z, int red, int green, int blue) {
   if (coordOutOfRange(x,y,z)) return;
   if (RGBIntensityOutOfRange(red, green, blue)) return;
 
+  int spectrum = limitRGBCurrent(&red, &green, &blue);
 
-#if LIMIT_CURRENT 
-  if(outOfRGBSpectrum(red, green, blue)) {
-   // setRGBVoxelSpectrum(x, y, z, reduceRGBToSpectrum(red, green, blue));
-    Cube.setRGB(z, RGBChannel(x,y), red, green, blue); 
-  } else {
-    Cube.setRGB(z, RGBChannel(x,y), red, green, blue); 
-  }
-#else
-   // setRGB(layer, channel, r, g, b);
-   Cube.setRGB(z, RGBChannel(x,y), red, green, blue); 
-#endif    
+  // setRGB(layer, channel, r, g, b);
+  Cube.setRGB(z, RGBChannel(x,y), red, green, blue);
+  cube_SpectrumData[z][RGBChannel(x,y)] = spectrum;
 }
 
 
@@ -209,115 +460,114 @@ void Draw::clearRGBVoxel(int x, int y, int z) {
 
   // setRGB(layer, channel, r, g, b);
   Cube.setRGB(z, RGBChannel(x,y), 0, 0, 0);  
+  cube_SpectrumData[z][RGBChannel(x,y)] = 0;
 }
 
 void Draw::setRGBVoxelSpectrum(int x, int y, int z, int spectrum) {
-    if (spectrum == 0) {
-       setRGBVoxel(x, y, z, 0, 0, 0);
-       return;
-    }
-
     if (spectrumOutOfRange(spectrum)) return; //12288 spectrum colors
     if (coordOutOfRange(x,y,z)) return;
 
-    int red, green, blue;
+    int red = 0, green = 0, blue = 0;
 
-    //cube_SpectrumData[z][RGBChannel(x,y)] = spectrum;
-    spectrum--;
+    if (spectrum != 0) spectrumToRGB(spectrum, &red, &green, &blue);
 
-    if (spectrum <= 4095)
-    {
-      red = 4095 - spectrum;            // red goes from on to off
-      green = spectrum;                 // green goes from off to on
-      blue = 0;                         // blue is always off
-    }
-    else if (spectrum <= 8191)  
-    {
-      red = 0;                          // red is always off
-      green = 4095 - (spectrum - 4096); // green on to off
-      blue = (spectrum - 4096);         // blue off to on
-    }
-    else // spectrum > 8191
-    {
-      red = (spectrum - 8192);         // red off to on
-      green = 0;                       // green is always off
-      blue = 4095 - (spectrum - 8192); // blue on to off
-    }
-    
-    setRGBVoxel(x, y, z, red, green, blue);  
+    Cube.setRGB(z, RGBChannel(x,y), red, green, blue);
+    cube_SpectrumData[z][RGBChannel(x,y)] = spectrum;
 }
 
+// One colour for the whole layer, so it is a single fill
 void Draw::setRGBSpectrumForLayer(int layer, int spectrum) {
-      for (int _x = 0; _x < CUBE_SIZE; _x++) {
-        for(int _y = 0; _y < CUBE_SIZE; _y++) {
-          setRGBVoxelSpectrum(_x, _y, layer, spectrum);
-        }
-      }
+    if (spectrumOutOfRange(spectrum)) return;
+    if (layer < 0 || layer >= CUBE_SIZE) return;
+
+    int red = 0, green = 0, blue = 0;
+
+    if (spectrum != 0) spectrumToRGB(spectrum, &red, &green, &blue);
+
+    Cube.fillRGBRows(layer, layer, 0, CUBE_SIZE * CUBE_SIZE, 1, 0, red, green, blue);
+    setSpectrumBox(0, 0, layer, CUBE_SIZE - 1, CUBE_SIZE - 1, layer, spectrum);
 }
 
 void Draw::setRGBSpectrumAll(int spectrum) {
-      for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-          setRGBSpectrumForLayer(_layer, spectrum);
-      }
-  
+    if (spectrumOutOfRange(spectrum)) return;
+
+    int red = 0, green = 0, blue = 0;
+
+    if (spectrum != 0) spectrumToRGB(spectrum, &red, &green, &blue);
+
+    Cube.fillRGBRows(0, CUBE_SIZE - 1, 0, CUBE_SIZE * CUBE_SIZE, 1, 0, red, green, blue);
+    setSpectrumBox(0, 0, 0, CUBE_SIZE - 1, CUBE_SIZE - 1, CUBE_SIZE - 1, spectrum);
 }
 
+// Comes from cube_SpectrumData, so a voxel set with setRGBVoxelSpectrum() reads
+// back exactly, even if the colours alone would be ambiguous
 int Draw::getRGBVoxelSpectrum(int x, int y, int z) {
     if (coordOutOfRange(x,y,z)) return -1;
 
-    int _red, _green, _blue;
-  
-    _red   = Cube.getRed(z, RGBChannel(x,y));
-    _green = Cube.getGreen(z, RGBChannel(x,y));
-    _blue  = Cube.getBlue(z, RGBChannel(x,y));
+    int _spectrum = cube_SpectrumData[z][RGBChannel(x,y)];
 
-    int _spectrum = 0;
+    if (_spectrum == SPECTRUM_UNKNOWN) {
+      _spectrum = spectrumFromRGB(Cube.getRed(z, RGBChannel(x,y)),
+                                  Cube.getGreen(z, RGBChannel(x,y)),
+                                  Cube.getBlue(z, RGBChannel(x,y)));
+      cube_SpectrumData[z][RGBChannel(x,y)] = _spectrum;
+    }
 
-    if ((_red == _green) && (_green == _blue)) return _spectrum; // LED is most likely off
+    return _spectrum;
+}
 
-    if ((_blue == 0) && (_red != 0)) {
-             _spectrum = _green; // spectrum from 0 to 4095
+// Voxels that are off stay off. The spectrum wraps around in both directions.
+void Draw::increaseRGBSpectrum(int x, int y, int z, int amount) {
+    int _spectrum = getRGBVoxelSpectrum(x, y, z);
 
-    } else if ((_red == 0) && (_green != 0)) {
-      _spectrum = _blue + 4096; // spectrum from 4096 to 8191
+    if (_spectrum <= 0) return;
 
-    } else {
-      _spectrum = _red + 8192; // spectrum from 8192 to 12287
-    }
-  
-    _spectrum++; //For Data storage
-    return _spectrum;
-
-//   return cube_SpectrumData[z][RGBChannel(x,y)];
+    setRGBVoxelSpectrum(x, y, z, wrapSpectrum(_spectrum + amount));
 }
 
+// The layer is read out of the cube with one getRange(), every voxel that is on
+// moves along the spectrum in cube_SpectrumData, and it all goes back with one
+// setRange(), which packs 8 channels at a time.
+void Draw::increaseRGBSpectrumForLayer(int layer, int amount) {
+    if (layer < 0 || layer >= CUBE_SIZE) return;
 
-void Draw::increaseRGBSpectrum(int x, int y, int z, int amount) {
-    int _spectrum = getRGBVoxelSpectrum(x, y, z);
-    //int _spectrum = cube_SpectrumData[z][RGBChannel(x,y)];
+    uint16_t _values[CUBE_SIZE * CUBE_SIZE * LED_SIZE];
+    uint16_t *_spectrum = cube_SpectrumData[layer];
+    int red, green, blue;
 
-    if (_spectrum == 0) return;
+    Cube.getRange(layer, 0, _values, CUBE_SIZE * CUBE_SIZE * LED_SIZE);
 
-    _spectrum += amount;
+    for (int _voxel = 0; _voxel < CUBE_SIZE * CUBE_SIZE; _voxel++) {
+      uint16_t *_rgb = _values + _voxel * LED_SIZE; // blue, green, red
+
+      if (_spectrum[_voxel] == SPECTRUM_UNKNOWN) {
+        _spectrum[_voxel] = spectrumFromRGB(_rgb[2], _rgb[1], _rgb[0]);
+      }
+      if (_spectrum[_voxel] == 0) continue;
 
-    if(spectrumOutOfRange(_spectrum)) {
-       _spectrum = _spectrum - getMaxSpectrum();
+      _spectrum[_voxel] = wrapSpectrum(_spectrum[_voxel] + amount);
+      spectrumToRGB(_spectrum[_voxel], &red, &green, &blue);
+      _rgb[0] = blue;
+      _rgb[1] = green;
+      _rgb[2] = red;
     }
 
-    setRGBVoxelSpectrum(x, y, z, _spectrum);
+    Cube.setRange(layer, 0, _values, CUBE_SIZE * CUBE_SIZE * LED_SIZE);
 }
 
-void Draw::increaseRGBSpectrumForLayer(int layer, int amount) {
-    for (int _x = 0; _x < CUBE_SIZE; _x++) {
-       for(int _y = 0; _y < CUBE_SIZE; _y++) {
-            increaseRGBSpectrum(_x, _y, layer, amount);
-       }
+void Draw::increaseRGBSpectrumAll(int amount) {
+    for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
+      increaseRGBSpectrumForLayer(_layer, amount);
     }
 }
 
-void Draw::increaseRGBSpectrumAll(int amount) {
+// Marks every voxel's spectrum as unknown, so it is worked out again from the
+// colours in the cube. Call it after drawing straight through Cube.
+void Draw::resyncRGBSpectrum(void) {
     for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-      increaseRGBSpectrumForLayer(_layer, amount);
+      for (int _voxel = 0; _voxel < CUBE_SIZE * CUBE_SIZE; _voxel++) {
+        cube_SpectrumData[_layer][_voxel] = SPECTRUM_UNKNOWN;
+      }
     }
 }
 
@@ -340,8 +590,19 @@ unsigned char Draw::outOfRGBSpectrum(int red, int green, int blue) {
       return 1;
 }
 
+// Shares 4095 between two colours in proportion to them, in integers: second
+// gets second * 4095 / (first + second) rounded down and first the rest, so the
+// two always add up to 4095. first + second must be 1 to 8190.
+static void shareSpectrum(int first, int second, int *_first, int *_second) {
+    *_second = second * 4095 / (first + second);
+    *_first = 4095 - *_second;
+}
+
+// Takes the smallest colour out of all three (the white part) and spreads the
+// other two over the spectrum. Integer only: one divide, no floating point.
+// Gives the same colours as the float code it replaced, except where that one
+// came out a step low or didn't add up to 4095.
 int Draw::reduceRGBToSpectrum(int red, int green, int blue) {
-  float _tmp;
   int _red, _green, _blue;
 
     if ((red == green) && (green == blue)) {
@@ -351,47 +612,54 @@ int Draw::reduceRGBToSpectrum(int red, int green, int blue) {
 
     } else if ((red <= green) && (red <= blue)) {
         _red = 0;
-        green -= red;
-        blue -= red; 
-
-        _tmp = green + blue;
-        _tmp = 4095.00 / _tmp;
-
-        _green = (int)(green *_tmp);
-        _blue = (int)(blue *_tmp);
-        // Most numbers will add up to 4094 after floating point is truncated
-        if((_green + _blue) != 4095) _green++; 
+        shareSpectrum(green - red, blue - red, &_green, &_blue);
 
     } else if ((green <= red) && (green <= blue)) {
         _green = 0;
-        red -= green;
-        blue -= green; 
-
-        _tmp = red + blue;
-        _tmp = 4095.00 / _tmp;
-
-        _red = (int)(red *_tmp);
-        _blue = (int)(blue *_tmp);
-
-        if((_red + _blue) != 4095) _blue++; 
+        shareSpectrum(blue - green, red - green, &_blue, &_red);
 
     } else { // Blue is less than the others
         _blue = 0;
-        red -= blue;
-        green -= blue; 
-
-        _tmp = red + green;
-        _tmp = 4095.00 / _tmp;
-
-        _red = (int)(red *_tmp);
-        _green = (int)(green *_tmp);
-
-        if((_red + _green) != 4095) _red++; 
+        shareSpectrum(red - blue, green - blue, &_red, &_green);
     } 
 
     return spectrumFromRGB(_red, _green, _blue);
 }
 
+// Scales a colour down so the three add up to no more than 4095, keeping their
+// ratios. The scale is a Q16 fraction worked out once, so each colour is one
+// multiply and a shift. Only for colours that are out of the spectrum (see
+// outOfRGBSpectrum()), which keeps the fraction under 1. Each colour can come
+// out one below colour * 4095 / sum rounded down, never further.
+void Draw::scaleRGBToSpectrum(int *red, int *green, int *blue) {
+    uint32_t _scale = (4095UL << 16) / (*red + *green + *blue);
+
+    *red   = (*red   * _scale) >> 16;
+    *green = (*green * _scale) >> 16;
+    *blue  = (*blue  * _scale) >> 16;
+}
+
+// Applies LIMIT_CURRENT to a colour that is already known to be 0-4095: one
+// that is out of the spectrum (see outOfRGBSpectrum()) becomes its spectrum
+// colour, or is dimmed if it is grey. Returns the spectrum to keep for it in
+// cube_SpectrumData. Every RGB primitive calls this once per colour, so they all
+// light a voxel the same way setRGBVoxel() does.
+int Draw::limitRGBCurrent(int *red, int *green, int *blue) {
+#if LIMIT_CURRENT
+  if (outOfRGBSpectrum(*red, *green, *blue)) {
+    if ((*red == *green) && (*green == *blue)) {
+      // Grey has no spectrum colour, so it is only dimmed
+      scaleRGBToSpectrum(red, green, blue);
+    } else {
+      int spectrum = reduceRGBToSpectrum(*red, *green, *blue);
+      spectrumToRGB(spectrum, red, green, blue);
+      return spectrum;
+    }
+  }
+#endif
+  return spectrumFromRGB(*red, *green, *blue);
+}
+
 int Draw::spectrumFromRGB(int red, int green, int blue) {
     int _spectrum = 0;
 
@@ -428,86 +696,122 @@ unsigned char Draw::RGBIntensityOutOfRange(int red, int green, int blue) {
     return 1;
 }
 
+// Cohen-Sutherland outcode of a voxel: one bit for each face of the cube it is beyond
+static int outCode(int x, int y, int z) {
+  int code = 0;
+
+  if (x < 0) code |= 0x01; else if (x >= CUBE_SIZE) code |= 0x02;
+  if (y < 0) code |= 0x04; else if (y >= CUBE_SIZE) code |= 0x08;
+  if (z < 0) code |= 0x10; else if (z >= CUBE_SIZE) code |= 0x20;
+
+  return code;
+}
+
+// Voxels an axis has moved over by step n of a line that moves it d voxels in
+// dmax steps (see drawRGBLine()): n * d / dmax rounded to nearest, halves down
+static int lineOffset(int n, int d, int dmax) {
+  return (2 * d * n + dmax - 1) / (2 * dmax);
+}
+
+// Narrows the steps first to last of a line (see drawRGBLine()) down to the ones
+// on which an axis, starting at p and moving d voxels in direction s over dmax
+// steps, is inside the cube. Returns 0 if there are none left.
+static int clipLineSteps(int p, int s, int d, int dmax, int *first, int *last) {
+  // The axis is in the cube from the kIn-th voxel it moves over to the kOut-th
+  int kIn, kOut;
+  if (s > 0) { kIn = -p; kOut = (CUBE_SIZE - 1) - p; }
+  else       { kIn = p - (CUBE_SIZE - 1); kOut = p; }
+
+  if (kOut < 0) return 0;
+  if (d == 0) return kIn <= 0;
+
+  // First step with lineOffset() >= kIn, last step with lineOffset() <= kOut
+  if (kIn > 0) {
+    int n = (2 * dmax * kIn - dmax + 2 * d) / (2 * d);
+    if (n > *first) *first = n;
+  }
+  int n = (2 * dmax * (kOut + 1) - dmax) / (2 * d);
+  if (n < *last) *last = n;
+
+  return *first <= *last;
+}
+
 // Draw a line between any coordinates in 3d space.
+// 3D Bresenham: every axis keeps an integer error term, so there is no floating
+// point (a software library call on the chipKIT) anywhere. The axis that changes
+// the most steps on every voxel and the others are rounded to the nearest voxel,
+// so axis-aligned and 45 degree lines come out exactly as before; the others can
+// differ by one voxel where the old code truncated.
+// The colour is checked and limited (limitRGBCurrent()) and the line clipped to
+// the cube once, so every voxel goes straight to Cube.setRGBUnchecked() with the
+// same colour setRGBVoxel() would give it. The clipped line draws exactly the
+// voxels of the whole line that are inside the cube.
 void Draw::drawRGBLine(int x1, int y1, int z1, int x2, int y2, int z2, int red, int green, int blue) {
-  int dx,dy,dz;
+  if (RGBIntensityOutOfRange(red, green, blue)) return;
+
+  int spectrum = limitRGBCurrent(&red, &green, &blue);
+
+  int dx,dy,dz,dmax;
 
   if( x1 >= x2 ) { dx = x1 - x2; } else { dx = x2 - x1; }
   if( y1 >= y2 ) { dy = y1 - y2; } else { dy = y2 - y1; }
   if( z1 >= z2 ) { dz = z1 - z2; } else { dz = z2 - z1; }
 
-  // Change in X is greatest
-  if((dx >= dy) && (dx >= dz)) {
-  		  float xy;  // how many voxels do we move on the y axis for each step on the x axis
-  		  float xz;  // how many voxels do we move on the y axis for each step on the x axis 
-  		  int x,y,z,lowesty,lowestz;
-
-  		  // We always want to draw the line from x=0 to x=7.
-		  // If x1 is bigger than x2, we need to flip all the values.
-		  if (x1 > x2) {
-		    int tmp;
-		    tmp = x2; x2 = x1; x1 = tmp;
-		    tmp = y2; y2 = y1; y1 = tmp;
-		    tmp = z2; z2 = z1; z1 = tmp;
-		  }
-		
-		  xy = (float)(y2-y1)/(float)(x2-x1);
-
-		  xz = (float)(z2-z1)/(float)(x2-x1);
-
-		  for (x = x1; x <= x2; x++) {
-		    y = (int)(xy * (x - x1)) + y1;
-		    z = (int)(xz * (x - x1)) + z1;
-		    setRGBVoxel(x, y, z, red, green, blue);
-		  }
-
-  // Change in Y is greatest
-  } else if ((dy >= dx) && (dy >= dz)) {
-
-  		  float yx;
-  		  float yz;
-  		  int x,y,z;
-
-		  if (y1 > y2) {
-		    int tmp;
-		    tmp = x2; x2 = x1; x1 = tmp;
-		    tmp = y2; y2 = y1; y1 = tmp;
-		    tmp = z2; z2 = z1; z1 = tmp;
-		  }
-
-		  yx = (float)(x2-x1)/(float)(y2-y1);
-
-		  yz = (float)(z2-z1)/(float)(y2-y1);
-
-		  for (y = y1; y <= y2; y++) {
-		    x = (int)(yx * (y - y1)) + x1;
-		    z = (int)(yz * (y - y1)) + z1;
-		    setRGBVoxel(x, y, z, red, green, blue);
-		  }
-
-  // Change in Z is greatest
-  } else {
+  // Always draw from the low end of the axis that changes the most, so that
+  // swapping the two ends draws the same voxels
+  int flip;
+  if ((dx >= dy) && (dx >= dz)) { dmax = dx; flip = (x1 > x2); }
+  else if (dy >= dz)            { dmax = dy; flip = (y1 > y2); }
+  else                          { dmax = dz; flip = (z1 > z2); }
+
+  if (flip) {
+    int tmp;
+    tmp = x2; x2 = x1; x1 = tmp;
+    tmp = y2; y2 = y1; y1 = tmp;
+    tmp = z2; z2 = z1; z1 = tmp;
+  }
+
+  int sx = (x2 >= x1) ? 1 : -1;
+  int sy = (y2 >= y1) ? 1 : -1;
+  int sz = (z2 >= z1) ? 1 : -1;
+
+  // An axis moves over once its error is past the middle of a voxel. For the
+  // axis with dmax the error starts at dmax and stays there, so it moves every time.
+  int ex = 2 * dx - dmax;
+  int ey = 2 * dy - dmax;
+  int ez = 2 * dz - dmax;
+
+  // Steps of the line that are inside the cube
+  int first = 0, last = dmax;
+  int code1 = outCode(x1, y1, z1);
+  int code2 = outCode(x2, y2, z2);
+
+  // Both ends beyond the same face: nothing to draw
+  if (code1 & code2) return;
+
+  // One of the ends is outside: cut the steps down to the ones where all three
+  // axes are in, and start the error terms where they would be on step first
+  if (code1 | code2) {
+    if (!clipLineSteps(x1, sx, dx, dmax, &first, &last)) return;
+    if (!clipLineSteps(y1, sy, dy, dmax, &first, &last)) return;
+    if (!clipLineSteps(z1, sz, dz, dmax, &first, &last)) return;
+
+    int k;
+    k = lineOffset(first, dx, dmax); x1 += sx * k; ex += 2 * (dx * first - dmax * k);
+    k = lineOffset(first, dy, dmax); y1 += sy * k; ey += 2 * (dy * first - dmax * k);
+    k = lineOffset(first, dz, dmax); z1 += sz * k; ez += 2 * (dz * first - dmax * k);
+  }
+
+  for (int n = first; n <= last; n++) {
+    Cube.setRGBUnchecked(z1, RGBChannel(x1, y1), red, green, blue);
+    cube_SpectrumData[z1][RGBChannel(x1, y1)] = spectrum;
 
-		  float zx;
-  		  float zy;
-  		  int x,y,z;
-
-		  if (z1 > z2) {
-		    int tmp;
-		    tmp = x2; x2 = x1; x1 = tmp;
-		    tmp = y2; y2 = y1; y1 = tmp;
-		    tmp = z2; z2 = z1; z1 = tmp;
-		  }
-
-		  zx = (float)(x2-x1)/(float)(z2-z1);
-
-		  zy = (float)(y2-y1)/(float)(z2-z1);
-		 
-		  for (z = z1; z <= z2; z++) {
-		    x = (int)(zx * (z - z1)) + x1;
-		    y = (int)(zy * (z - z1)) + y1;
-		    setRGBVoxel(x, y, z, red, green, blue);
-		  }
+    if (ex > 0) { x1 += sx; ex -= 2 * dmax; }
+    if (ey > 0) { y1 += sy; ey -= 2 * dmax; }
+    if (ez > 0) { z1 += sz; ez -= 2 * dmax; }
+    ex += 2 * dx;
+    ey += 2 * dy;
+    ez += 2 * dz;
   }
 } // End of drawRGBLine()
 
@@ -610,10 +914,35 @@ void Draw::drawLineRGBCube(int x, int y, int z, int orientation, int size, int r
 	drawRGBLine(x2, y, z2, x2, y2, z2, red, green, blue); // Left Horizontal Top
 }
 
+// Sorts the two ends of a range and clips it to the cube. Returns 0 if none of
+// it is in the cube.
+static int clipRange(int *lo, int *hi) {
+  if (*lo > *hi) { int tmp = *lo; *lo = *hi; *hi = tmp; }
+
+  if (*lo < 0) *lo = 0;
+  if (*hi > CUBE_SIZE - 1) *hi = CUBE_SIZE - 1;
+
+  return *lo <= *hi;
+}
+
+// Fills the box between two corners with a colour that has already been checked
+// and limited (limitRGBCurrent()).
+// The box is clipped to the cube once. On every layer each x is a run of
+// RGBChannel(x, y) to RGBChannel(x, y2), so the box goes to the cube as one
+// run per x (Cube.fillRGBRows()) and is written into the packed words a word at a time.
+// spectrum is what goes into cube_SpectrumData for the box.
+static void fillRGBBox(int x, int y, int z, int x2, int y2, int z2, int red, int green, int blue, int spectrum) {
+  if (!clipRange(&x, &x2) || !clipRange(&y, &y2) || !clipRange(&z, &z2)) return;
+
+  Cube.fillRGBRows(z, z2, x * CUBE_SIZE + y, y2 - y + 1, x2 - x + 1, CUBE_SIZE, red, green, blue);
+  setSpectrumBox(x, y, z, x2, y2, z2, spectrum);
+}
+
 // Draws a filled in cube starting from the x,y,z coordinatie moving out based on the orientation and size
 void Draw::drawFillRGBCube(int x, int y, int z, int orientation, int size, int red, int green, int blue)
 {
 	if ((orientation > 8) || (orientation < 1)) return;
+	if (RGBIntensityOutOfRange(red, green, blue)) return;
 
 	// Orientation: (Corner which x,y,z are drawn from)
 	// 1: Forward Bottom Right
@@ -625,7 +954,7 @@ void Draw::drawFillRGBCube(int x, int y, int z, int orientation, int size, int r
 	// 7: Back Top Left
 	// 8: Back Top Right
 
-	int x2, y2, z2, tmp;
+	int x2, y2, z2;
 
     switch (orientation) {
     	case 1:
@@ -689,17 +1018,8 @@ void Draw::drawFillRGBCube(int x, int y, int z, int orientation, int size, int r
     		break;
     }
 
-    if (x > x2) { tmp = x; x = x2; x2 = tmp; }
-    if (y > y2) { tmp = y; y = y2; y2 = tmp; }
-    if (z > z2) { tmp = z; z = z2; z2 = tmp; }
-
-    for (int _z = z; _z <= z2; _z++) {
-    	for (int _x = x; _x <= x2; _x++) {
-    		for (int _y = y; _y <= y2; _y++) {
-    				setRGBVoxel(_x,_y,_z,  red, green, blue);
-    		}
-    	}
-    }
+    int spectrum = limitRGBCurrent(&red, &green, &blue);
+    fillRGBBox(x, y, z, x2, y2, z2, red, green, blue, spectrum);
 }
 
 // Draws a box from corner to corner based on orientation
@@ -784,6 +1104,7 @@ void Draw::drawLineRGBBox(int x, int y, int z, int x2, int y2, int z2, int orien
 void Draw::drawFillRGBBox(int x, int y, int z, int x2, int y2, int z2, int orientation, int red, int green, int blue)
 {
 	if ((orientation > 8) || (orientation < 1)) return;
+	if (RGBIntensityOutOfRange(red, green, blue)) return;
 
 	// Orientation: (Corner which x,y,z are drawn from)
 	// 1: Forward Bottom Right
@@ -795,8 +1116,6 @@ void Draw::drawFillRGBBox(int x, int y, int z, int x2, int y2, int z2, int orien
 	// 7: Back Top Left
 	// 8: Back Top Right
 
-	int tmp;
-
     switch (orientation) {
     	case 1:
         // Do nothing 
@@ -841,41 +1160,30 @@ void Draw::drawFillRGBBox(int x, int y, int z, int x2, int y2, int z2, int orien
     		break;
     }
 
-    if (x > x2) { tmp = x; x = x2; x2 = tmp; }
-    if (y > y2) { tmp = y; y = y2; y2 = tmp; }
-    if (z > z2) { tmp = z; z = z2; z2 = tmp; }
-
-    for (int _z = z; _z <= z2; _z++) {
-    	for (int _x = x; _x <= x2; _x++) {
-    		for (int _y = y; _y <= y2; _y++) {
-    				setRGBVoxel(_x,_y,_z,  red, green, blue);
-    		}
-    	}
-    }
+    int spectrum = limitRGBCurrent(&red, &green, &blue);
+    fillRGBBox(x, y, z, x2, y2, z2, red, green, blue, spectrum);
 
 }
 
 // Sets all voxels along a Y/Z plane at a given point on axis X
+// One run of CUBE_SIZE voxels on every layer
 void Draw::setRGBPlaneX(int x, int red, int green, int blue) {
   if (RGBIntensityOutOfRange(red, green, blue)) return;
   if (x >= 0 && x < CUBE_SIZE) {
-		for(int z = 0; z < CUBE_SIZE; z++) {
-			    for (int c = (x * CUBE_SIZE); c < ((x * CUBE_SIZE) + CUBE_SIZE); c++) {
-			      Cube.setRGB(z, c, red, green, blue); 
-			    }
-		 }
+      int spectrum = limitRGBCurrent(&red, &green, &blue);
+      Cube.fillRGBRows(0, CUBE_SIZE - 1, x * CUBE_SIZE, CUBE_SIZE, 1, 0, red, green, blue);
+      setSpectrumBox(x, 0, 0, x, CUBE_SIZE - 1, CUBE_SIZE - 1, spectrum);
   }
 }
 
 // Sets all voxels along a X/Z plane at a given point on axis Y
+// Runs of one voxel, CUBE_SIZE channels apart
 void Draw::setRGBPlaneY(int y, int red, int green, int blue) {
   if (RGBIntensityOutOfRange(red, green, blue)) return;
   if (y >= 0 && y < CUBE_SIZE) {
-    for(int z = 0; z < CUBE_SIZE; z++) {
-          for (int c = y; c < RGB_CHANNELS; c += CUBE_SIZE) {
-            Cube.setRGB(z, c, red, green, blue); 
-          }
-     }
+      int spectrum = limitRGBCurrent(&red, &green, &blue);
+      Cube.fillRGBRows(0, CUBE_SIZE - 1, y, 1, (RGB_CHANNELS - y + CUBE_SIZE - 1) / CUBE_SIZE, CUBE_SIZE, red, green, blue);
+      setSpectrumBox(0, y, 0, CUBE_SIZE - 1, y, CUBE_SIZE - 1, spectrum);
   }
 }
 
@@ -883,9 +1191,110 @@ void Draw::setRGBPlaneY(int y, int red, int green, int blue) {
 void Draw::setRGBPlaneZ(int z, int red, int green, int blue) {
   if (RGBIntensityOutOfRange(red, green, blue)) return;
   if (z >= 0 && z < CUBE_SIZE) {
-      for (int c = 0; c < RGB_CHANNELS; c++) {
-        Cube.setRGB(z, c, red, green, blue); 
+      int spectrum = limitRGBCurrent(&red, &green, &blue);
+      Cube.setAllRGBOnLayer(z, red, green, blue);
+      setSpectrumBox(0, 0, z, CUBE_SIZE - 1, CUBE_SIZE - 1, z, spectrum);
+  }
+}
+
+// Works out which voxels first..last (0 to size - 1) of a sprite placed at at
+// land in the cube along one axis, counting from the far end if flip is set.
+// Returns 0 if none do.
+static int clipSprite(int at, int size, int flip, int *first, int *last) {
+  int lo = (at < 0) ? -at : 0;
+  int hi = (at + size > CUBE_SIZE) ? CUBE_SIZE - 1 - at : size - 1;
+
+  *first = flip ? size - 1 - hi : lo;
+  *last = flip ? size - 1 - lo : hi;
+
+  return lo <= hi;
+}
+
+// Draws a sprite (see DrawSprite in Draw.h) with its voxel 0, 0, 0 at x, y, z,
+// or flipped along any axis by the flags. The sprite is clipped to the cube
+// once. The part of each row in the cube is one run of channels, so it is built
+// from the runs in a buffer and goes to the cube with one Cube.setRange(), 8
+// channels to a packed group, or one per stretch between the voxels that are
+// left as they were. Layers past the last one in the cube are not read at all.
+// Voxels with palette index 0 are left as they are, or turned off with
+// DRAW_BLIT_OPAQUE. Runs with a colour that isn't 0-4095 are left too, and
+// the sprite stops at a run of length 0. Each run's colour is limited the same
+// way as setRGBVoxel() (limitRGBCurrent()).
+void Draw::blit(const DrawSprite *sprite, int x, int y, int z, int flags) {
+  int width = sprite->width, depth = sprite->depth, height = sprite->height;
+  int x0, x1, y0, y1, z0, z1;
+
+  if (!clipSprite(x, width, flags & DRAW_BLIT_FLIP_X, &x0, &x1)) return;
+  if (!clipSprite(y, depth, flags & DRAW_BLIT_FLIP_Y, &y0, &y1)) return;
+  if (!clipSprite(z, height, flags & DRAW_BLIT_FLIP_Z, &z0, &z1)) return;
+
+  // Voxels y0..y1 of every row land on y first..first + count - 1
+  int first = (flags & DRAW_BLIT_FLIP_Y) ? y + depth - 1 - y1 : y + y0;
+  int count = y1 - y0 + 1;
+  const uint8_t *run = sprite->runs;
+
+  for(int _z = 0; _z <= z1; _z++) {
+    int layer = (flags & DRAW_BLIT_FLIP_Z) ? z + height - 1 - _z : z + _z;
+
+    for(int _x = 0; _x < width; _x++) {
+      int row = (flags & DRAW_BLIT_FLIP_X) ? x + width - 1 - _x : x + _x;
+      int inCube = (_z >= z0) && (_x >= x0) && (_x <= x1);
+      uint16_t values[CUBE_SIZE * LED_SIZE];
+      uint16_t *spectrum = cube_SpectrumData[0];
+      uint32_t kept = 0;	// bit i set: voxel first + i stays as it is
+
+      if (inCube) spectrum = cube_SpectrumData[layer] + RGBChannel(row, first);
+
+      for(int _y = 0; _y < depth; run += 2) {
+        int length = run[0], index = run[1];
+        int from = (_y > y0) ? _y : y0;
+        int to = (_y + length - 1 < y1) ? _y + length - 1 : y1;
+
+        if (length == 0) return;
+        _y += length;
+        if (!inCube || (from > to)) continue;
+
+        // Where the run goes along the row, back to front if flipped
+        int at = (flags & DRAW_BLIT_FLIP_Y) ? (y + depth - 1 - to) - first : (y + from) - first;
+        int n = to - from + 1;
+        int red = 0, green = 0, blue = 0;
+
+        if (index != 0) {
+          red = sprite->palette[index][0];
+          green = sprite->palette[index][1];
+          blue = sprite->palette[index][2];
+        }
+        if (((index == 0) && !(flags & DRAW_BLIT_OPAQUE)) || RGBIntensityOutOfRange(red, green, blue)) {
+          kept |= (0xFFFFFFFFUL >> (32 - n)) << at;
+          continue;
+        }
+
+        uint16_t *out = values + at * LED_SIZE;
+        int voxelSpectrum = limitRGBCurrent(&red, &green, &blue);
+
+        for(int i = at; i < at + n; i++) {
+          *out++ = blue;
+          *out++ = green;
+          *out++ = red;
+          spectrum[i] = voxelSpectrum;
+        }
+      }
+
+      if (!inCube) continue;
+
+      // Each stretch of the row between voxels that stay goes out as one range
+      for(int i = 0; i < count; ) {
+        if (kept & (1UL << i)) {
+          i++;
+          continue;
+        }
+        int end = i + 1;
+        while ((end < count) && !(kept & (1UL << end))) end++;
+
+        Cube.setRange(layer, RGBChannel(row, first + i) * LED_SIZE, values + i * LED_SIZE, (end - i) * LED_SIZE);
+        i = end;
       }
+    }
   }
 }
 
@@ -23,6 +23,30 @@ http://playground.arduino.cc/learning/TLC5940
 #define DRAW_H
 #include <LEDCube.h>
 
+#if RGB_LEDS
+// Flags for Draw::blit()
+#define DRAW_BLIT_OPAQUE	0x01	// Palette index 0 turns voxels off instead of leaving them
+#define DRAW_BLIT_FLIP_X	0x02	// Draw the sprite back to front along X
+#define DRAW_BLIT_FLIP_Y	0x04	// ... along Y
+#define DRAW_BLIT_FLIP_Z	0x08	// ... upside down
+
+// A small 3D shape for Draw::blit(). Declare it and its arrays const and the
+// PIC32 keeps them all in flash; blit() reads them from there.
+//
+// runs is one row along Y for every x of every z (z = 0 first, then x = 0
+// first), and each row is (length, palette index) byte pairs adding up to
+// depth. Index 0 is the transparency key: blit() skips those voxels. The
+// others pick an entry of palette ({ red, green, blue }, 0-4095; entry 0 is
+// never read).
+struct DrawSprite {
+	uint8_t width;		// size along X
+	uint8_t depth;		// size along Y
+	uint8_t height;		// size along Z
+	const uint16_t (*palette)[3];
+	const uint8_t *runs;
+};
+#endif
+
 
 class Draw
 {
@@ -43,6 +67,13 @@ class Draw
 		void shiftCubeX(int direction);
 		void shiftCubeY(int direction);
 		void shiftCubeZ(int direction);
+		void rotateCubeX(int direction);
+		void rotateCubeY(int direction);
+		void rotateCubeZ(int direction);
+		void rotateCube90(int axis, int turns);
+		void mirrorCube(int axis);
+		void transposeCube(void);
+		void transformCube(int angleX, int angleY, int angleZ, int scale, int smooth);
 
 	#if RGB_LEDS // RGB Functions
 		void setRGBVoxel(int x, int y, int z, int red, int green, int blue);
@@ -54,11 +85,14 @@ class Draw
 		void increaseRGBSpectrum(int x, int y, int z, int amount);
 		void increaseRGBSpectrumForLayer(int layer, int amount);
 		void increaseRGBSpectrumAll(int amount);
+		void resyncRGBSpectrum(void);
 		int getMaxSpectrum(void);
 		unsigned char spectrumOutOfRange(int spectrum);
 		unsigned char outOfRGBSpectrum(int red, int green, int blue);
 		int spectrumFromRGB(int red, int green, int blue);
 		int reduceRGBToSpectrum(int red, int green, int blue);
+		void scaleRGBToSpectrum(int *red, int *green, int *blue);
+		int limitRGBCurrent(int *red, int *green, int *blue);
 		int RGBChannel(int x, int y);
 		unsigned char RGBIntensityOutOfRange(int red, int green, int blue);
 		void drawRGBLine(int x1, int y1, int z1, int x2, int y2, int z2, int red, int green, int blue);
@@ -69,6 +103,7 @@ class Draw
 		void setRGBPlaneX(int x, int red, int green, int blue);
 		void setRGBPlaneY(int y, int red, int green, int blue);
 		void setRGBPlaneZ(int z, int red, int green, int blue);
+		void blit(const DrawSprite *sprite, int x, int y, int z, int flags);
 	#else // Mono LED Functions
 
 
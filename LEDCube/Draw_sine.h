@@ -0,0 +1,65 @@
+/** Sine table for Draw::transformCube().
+
+    draw_sineTable[d] = round(16384 * sin(d degrees)) for d = 0 to 90, so the
+    sine or cosine of any whole angle is a lookup and a sign (see sineQ14() in
+    Draw.cpp). The compiler works the table out from the constexpr functions
+    below, so it ends up in flash and the chipKIT never does any floating point
+    math for it. Needs a C++11 compiler (-std=gnu++11). */
+
+#ifndef DRAW_SINE_H
+#define DRAW_SINE_H
+
+#include <stdint.h>
+
+#if __cplusplus < 201103L
+	#error "Draw_sine.h needs a C++11 compiler (-std=gnu++11)"
+#endif
+
+/** sin(x) = x - x^3/3! + x^5/5! - ... x is at most pi/2 here, so 11 terms are plenty. */
+constexpr double draw_sine_series(double x2, double term, int k)
+{
+	return (k > 21) ? 0.0 : term + draw_sine_series(x2, -term * x2 / ((k + 1) * (k + 2)), k + 2);
+}
+
+constexpr double draw_sine(double x)
+{
+	return draw_sine_series(x * x, x, 1);
+}
+
+constexpr int16_t draw_sine_value(int degrees)
+{
+	return (int16_t)(16384.0 * draw_sine(degrees * 3.14159265358979324 / 180.0) + 0.5);
+}
+
+/** DrawSineIndexes<0, 1, ..., N - 1> built by doubling, so the template depth
+    stays at about 2 * log2(N) */
+template<int... I> struct DrawSineIndexes {
+	typedef DrawSineIndexes<I..., (int)sizeof...(I) + I...> doubled;
+	typedef DrawSineIndexes<I..., (int)sizeof...(I)> plusOne;
+};
+
+template<int N, bool Odd = ((N & 1) != 0)> struct DrawSineMakeIndexes {
+	typedef typename DrawSineMakeIndexes<N / 2>::type::doubled type;
+};
+
+template<int N> struct DrawSineMakeIndexes<N, true> {
+	typedef typename DrawSineMakeIndexes<(N - 1)>::type::plusOne type;
+};
+
+template<> struct DrawSineMakeIndexes<0, false> {
+	typedef DrawSineIndexes<> type;
+};
+
+template<typename Indexes> struct DrawSineTable;
+
+template<int... I> struct DrawSineTable<DrawSineIndexes<I...> > {
+	static const int16_t values[sizeof...(I)];
+};
+
+template<int... I> const int16_t DrawSineTable<DrawSineIndexes<I...> >::values[sizeof...(I)] = {
+	draw_sine_value(I)...
+};
+
+#define draw_sineTable	(DrawSineTable<DrawSineMakeIndexes<91>::type>::values)
+
+#endif
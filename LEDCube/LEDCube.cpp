@@ -21,7 +21,13 @@ http://playground.arduino.cc/learning/TLC5940
 
 #include <LEDCube_config.h>
 #include "LEDCube.h"
+#include "LEDCube_chain.h"
 #include <plib.h>
+#include <string.h>
+
+#if CUBE_GAMMA_ENABLED
+#include "LEDCube_gamma.h"
+#endif
 
 
 /** Macros to work with pins */
@@ -30,6 +36,12 @@ http://playground.arduino.cc/learning/TLC5940
 #define setHigh(port, pin)		port |= pin
 #define outputState(port, pin)	port & pin
 
+/** Body of the busy-wait loops. Nothing to do on the chipKIT; the host
+    simulator (HostSim/plib.h) defines it to let simulated time pass. */
+#ifndef busy_wait
+	#define busy_wait()
+#endif
+
 /** Chipkit Ports **/           // chipKitUno/uC32 Pins:
 #define VPRG 0x40               // pin 36 
 #define VPRG_PORT PORTD
@@ -45,6 +57,8 @@ http://playground.arduino.cc/learning/TLC5940
 
 #define SCLK 0x40               // pin 13
 #define SCLK_PORT PORTG
+#define SCLK_PORTSET PORTGSET
+#define SCLK_PORTCLR PORTGCLR
  
 #define GSCLK 0x1               // pin 3
 #define GSCLK_PORT PORTD
@@ -55,6 +69,30 @@ http://playground.arduino.cc/learning/TLC5940
 #define XLAT 0x8                // pin 9
 #define XLAT_PORT PORTD
 
+// DMA channel that feeds SPI2 in TLC_SPI_DMA mode. The handler at the 
+// bottom is tied to _DMA_0_VECTOR, so change both together.
+#define GS_DMA_CHN DMA_CHANNEL0
+
+// DMA channel that feeds SPI1 with CUBE_SPI_CHAINS 2. Tied to _DMA_1_VECTOR.
+#define CHAIN1_DMA_CHN DMA_CHANNEL1
+
+// Bit-banged SIN pins. TLC_PARALLEL puts chain n on RBn, TLC_BITBANG is a single
+// chain on SOUT.
+#if DATA_TRANSFER_MODE == TLC_PARALLEL
+#define SIN_CHAINS CUBE_PARALLEL_CHAINS
+#define SIN_SHIFT 0
+#define SIN_PORT PORTB
+#define SIN_PORTINV PORTBINV
+#define SIN_TRISCLR TRISBCLR
+#else
+#define SIN_CHAINS 1
+#define SIN_SHIFT 8             // SOUT
+#define SIN_PORT PORTG
+#define SIN_PORTINV PORTGINV
+#define SIN_TRISCLR TRISGCLR
+#endif
+#define SIN_MASK (((1 << SIN_CHAINS) - 1) << SIN_SHIFT)
+
 #define LAYER0 0x01             // pin 26
 #define LAYER0_TRIS TRISE
 #define LAYER0_PORT PORTE
@@ -111,35 +149,239 @@ http://playground.arduino.cc/learning/TLC5940
 
 // Creates a 2D Array which will hold all the required values of every LED 
 // Each layer holds the required number of bits for the TLC5940's  
-unsigned int cube_GSData[CUBE_SIZE][NUM_TLCS * 6]; // 6 * 32 = 192 bits = 16x 12bit values
+#if CUBE_DOUBLE_BUFFER
+unsigned int cube_GSBuffers[2][CUBE_SIZE][NUM_TLCS * 6]; // 6 * 32 = 192 bits = 16x 12bit values
+#else
+unsigned int cube_GSBuffers[1][CUBE_SIZE][NUM_TLCS * 6];
+#endif
+
+// Back buffer: every set()/Draw call writes here
+unsigned int (*cube_GSData)[NUM_TLCS * 6] = cube_GSBuffers[0];
+
+// Works out where a channel goes in one layer (see LEDCube_chain.h)
+typedef LEDCubeChain<NUM_TLCS> CubeLayerChain;
+
+// Front buffer: the layers that are being shifted out to the TLCs. Same as the 
+// back buffer unless CUBE_DOUBLE_BUFFER is on.
+#if CUBE_DOUBLE_BUFFER
+unsigned int (*cube_GSFront)[NUM_TLCS * 6] = cube_GSBuffers[1];
+#else
+unsigned int (*cube_GSFront)[NUM_TLCS * 6] = cube_GSBuffers[0];
+#endif
+
+// Set by present(), cleared by the XLAT interrupt once the buffers are swapped
+volatile uint8_t cube_needSwap;
+
+// Set when the buffers have been swapped and the back buffer still holds the frame
+// before the one that was presented (see presentPending())
+volatile uint8_t cube_needCopy;
+
+// The layers of every buffer form a ring: layer L is kept in buffer layer 
+// (L + cube_layerBase) % CUBE_SIZE. rotateLayers() moves every layer up or down
+// by changing the base, without moving any data.
+volatile uint8_t cube_layerBase;
+
+#if CUBE_DOUBLE_BUFFER
+// Base the front buffer was drawn with, and the one present() hands over with the 
+// back buffer. The XLAT interrupt copies one into the other when it swaps them.
+volatile uint8_t cube_frontBase;
+volatile uint8_t cube_presentBase;
+
+// Set by the XLAT interrupt while the frame on show is only partly latched, from
+// its first layer until its last one
+volatile uint8_t cube_midFrame;
+#else
+// Drawing and the scan-out share the one buffer
+#define cube_frontBase cube_layerBase
+#endif
+
+#if CUBE_WORKING_BUFFER
+// One plain 12-bit value per channel. set()/get() and the fills work on this and
+// present() packs the layers that have changed into cube_GSData.
+uint16_t cube_WorkData[CUBE_SIZE][NUM_TLCS * 16];
+
+// Bit n is set when layer n of cube_WorkData has changed since the last present()
+uint32_t cube_dirtyLayers;
+#endif
+
+#if CUBE_CURRENT_LIMIT
+// Sum of the values of every layer of cube_WorkData, and of the 16 channels of every
+// TLC on it, kept up to date by everything that writes to it
+uint32_t cube_layerSum[CUBE_SIZE];
+uint16_t cube_tlcSum[CUBE_SIZE][NUM_TLCS];
+#endif
+
+#if CUBE_GAMMA_ENABLED
+// Scales every value before the gamma table, 255 = full brightness
+uint8_t cube_brightness = 255;
+#endif
 
 #if RGB_LEDS
 	unsigned int cube_colorData[576]; // 576 * 32 = 18,432 / 36 Bits per color = 512 colors 
 #endif
 
 #if VPRG_ENABLED
-	/** Packed Dot Correction data. Packed similarly to GSData. Using an 8 bit uint because it's easier to pack. */
-	uint8_t tlc_DCData[NUM_TLCS * 12];
+	/** Packed Dot Correction data, 6 bits per channel and 3 words (96 bits) per TLC.
+	    Packed like GSData, last channel first, so it can go out over SPI2 as it is. */
+	unsigned int tlc_DCData[NUM_TLCS * 3];
 #endif 
 
 // This keeps track of the current layer the cube is displaying 
-uint8_t currentLayer = 0;
+volatile uint8_t currentLayer = 0;
 
 /** This will be true (!= 0) if update was just called and the data has not
     been latched in yet. */
 volatile uint8_t cube_needXLAT;
 
+// Number of DMA channels still feeding a layer to their SPI module (0 once it's all sent)
+volatile uint8_t cube_shifting;
+
+// States of the refresh engine (see startRefresh())
+#define REFRESH_OFF			0
+#define REFRESH_RUNNING		1
+#define REFRESH_STOPPING	2	// Finishing the layer that's already been sent
+
+volatile uint8_t cube_refreshState;
+
+// BLANK periods the current layer has been lit for, counted by the BLANK interrupt
+volatile uint8_t cube_heldCycles;
+
+#if VPRG_ENABLED && DATA_TRANSFER_MODE == TLC_SPI_DMA
+// DC asked for with updateDC() while the refresh engine runs: DC_QUEUED until the
+// XLAT interrupt sends it in place of the next layer, DC_SENT until it is latched
+#define DC_QUEUED	1
+#define DC_SENT		2
+volatile uint8_t cube_needDC;
+#endif
+
 /** Some of the extened library will need to be called after a successful
     update. */
 volatile void (*tlc_onUpdateFinished)(void);
 
 
-/** Returns > 0 if an update is currently in progress; else 0 */
+/** Returns > 0 if an update is currently in progress; else 0. While the refresh
+    engine runs there is always a layer on its way, so only a DC update that
+    updateDC() has handed to the engine counts, until the TLCs have latched it. */
 int LEDCube::updateInProgress() 
 {
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	if (cube_refreshState) {
+	#if VPRG_ENABLED
+		return cube_needDC;
+	#else
+		return 0;
+	#endif
+	}
+#endif
 	return cube_needXLAT;
 }
 
+// Returns where the last startUpdate()/update() is: CUBE_UPDATE_SHIFTING while the
+// layer is still being sent, CUBE_UPDATE_LATCHING until the XLAT pulse and 
+// CUBE_UPDATE_IDLE once the TLCs have it.
+int LEDCube::updateStatus(void)
+{
+	if (cube_shifting) return CUBE_UPDATE_SHIFTING;
+	if (cube_needXLAT) return CUBE_UPDATE_LATCHING;
+	return CUBE_UPDATE_IDLE;
+}
+
+#if CUBE_WORKING_BUFFER
+static void pack_dirty_layers(void);
+#endif
+
+// Buffer layer that holds layer (0 to CUBE_SIZE - 1) of the back buffer
+static inline int ring_layer(int layer)
+{
+	layer += cube_layerBase;
+	return (layer >= CUBE_SIZE) ? layer - CUBE_SIZE : layer;
+}
+
+// The front buffer data for the layer pin layer
+static inline unsigned int* front_layer(int layer)
+{
+	layer += cube_frontBase;
+	return cube_GSFront[(layer >= CUBE_SIZE) ? layer - CUBE_SIZE : layer];
+}
+
+#if CUBE_DOUBLE_BUFFER
+// Makes the back buffer the front one. Only the pointers move, so the XLAT
+// interrupt can call it; the new back buffer is brought up to date outside the
+// interrupt by copy_front_buffer().
+static void swap_buffers(void)
+{
+	unsigned int (*_shown)[NUM_TLCS * 6] = cube_GSData;
+	cube_GSData = cube_GSFront;
+	cube_GSFront = _shown;
+
+	cube_frontBase = cube_presentBase;
+	cube_needSwap = 0;
+	cube_needCopy = 1;
+}
+
+// Copies the frame that was presented into the back buffer after a swap, so 
+// drawing carries on from it. The front buffer is only read by the scan-out, so 
+// this is safe while it runs.
+static void copy_front_buffer(void)
+{
+	if (!cube_needCopy) return;
+
+	memcpy(cube_GSData, cube_GSFront, sizeof(cube_GSBuffers[0]));
+	cube_needCopy = 0;
+}
+#endif
+
+// Asks for the back buffer to be shown. The XLAT interrupt of the last layer swaps
+// the buffers, so a frame never tears, whether the refresh engine or a manual scan
+// is sending the layers. If nothing is being sent and the scan is between two 
+// frames (or hasn't shown one since init()), the swap happens straight away. A manual scan has to carry on to its last layer
+// for presentPending() to return 0.
+// Wait for presentPending() to return 0 before drawing the next frame: it also
+// copies the frame that was presented into the back buffer.
+// With CUBE_WORKING_BUFFER this first packs the layers that changed into the back 
+// buffer, which is the only way anything drawn gets to the cube, and drawing 
+// doesn't have to wait for presentPending(). Otherwise it does nothing without
+// CUBE_DOUBLE_BUFFER.
+void LEDCube::present(void)
+{
+#if CUBE_WORKING_BUFFER
+	// The back buffer can't be packed while the interrupt may swap it in, so take
+	// back a swap that is still pending; it is asked for again straight away
+	cube_needSwap = 0;
+
+	#if CUBE_DOUBLE_BUFFER
+	// Only the changed layers are packed, so start from the frame on show
+	copy_front_buffer();
+	#endif
+
+	pack_dirty_layers();
+#endif
+
+#if CUBE_DOUBLE_BUFFER
+	cube_presentBase = cube_layerBase;
+
+	// Between two frames of the scan and nothing on its way, so nothing can tear
+	if (!cube_refreshState && !cube_needXLAT && !cube_midFrame) {
+		swap_buffers();
+		return;
+	}
+
+	cube_needSwap = 1;
+#endif
+}
+
+// Returns 1 from present() until the buffers have been swapped. The first call 
+// after the swap copies the presented frame into the back buffer.
+int LEDCube::presentPending(void)
+{
+	if (cube_needSwap) return 1;
+
+#if CUBE_DOUBLE_BUFFER
+	copy_front_buffer();
+#endif
+	return 0;
+}
+
 void LEDCube::init(int initialValue)
 {
 	//Setting Directionality of ports	
@@ -160,9 +402,10 @@ void LEDCube::init(int initialValue)
 
 
 
-	#if DATA_TRANSFER_MODE == TLC_BITBANG
+	#if DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+	SIN_TRISCLR = SIN_MASK;
 
-	#elif DATA_TRANSFER_MODE == TLC_SPI
+	#elif DATA_TRANSFER_MODE == TLC_SPI || DATA_TRANSFER_MODE == TLC_SPI_DMA
 	//Setting up SPI
 	OpenSPI2(
 			SPI_MODE32_ON
@@ -171,6 +414,35 @@ void LEDCube::init(int initialValue)
 			| TLC_SPI_PRESCALER_FLAGS 
 			| FRAME_ENABLE_OFF, 
 		SPI_ENABLE);
+
+		#if CUBE_SPI_CHAINS == 2
+	// Second half of the chain
+	OpenSPI1(
+			SPI_MODE32_ON
+			| MASTER_ENABLE_ON 
+			| SPI_CKE_ON 
+			| TLC_SPI_PRESCALER_FLAGS 
+			| FRAME_ENABLE_OFF, 
+		SPI_ENABLE);
+		#endif
+	#endif
+
+	#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// Every time the SPI2 transmit buffer empties, the DMA channel moves the next word 
+	// of the layer into it. The block done interrupt then requests the XLAT pulse.
+	DmaChnOpen(GS_DMA_CHN, DMA_CHN_PRI3, DMA_OPEN_DEFAULT);
+	DmaChnSetEventControl(GS_DMA_CHN, DMA_EV_START_IRQ_EN | DMA_EV_START_IRQ(_SPI2_TX_IRQ));
+	DmaChnSetEvEnableFlags(GS_DMA_CHN, DMA_EV_BLOCK_DONE);
+	DmaChnSetIntPriority(GS_DMA_CHN, 3, 3);
+	DmaChnIntEnable(GS_DMA_CHN);
+
+		#if CUBE_SPI_CHAINS == 2
+	DmaChnOpen(CHAIN1_DMA_CHN, DMA_CHN_PRI3, DMA_OPEN_DEFAULT);
+	DmaChnSetEventControl(CHAIN1_DMA_CHN, DMA_EV_START_IRQ_EN | DMA_EV_START_IRQ(_SPI1_TX_IRQ));
+	DmaChnSetEvEnableFlags(CHAIN1_DMA_CHN, DMA_EV_BLOCK_DONE);
+	DmaChnSetIntPriority(CHAIN1_DMA_CHN, 3, 3);
+	DmaChnIntEnable(CHAIN1_DMA_CHN);
+		#endif
 	#endif
 
 	// Start the timer for GSCLK
@@ -190,6 +462,10 @@ void LEDCube::init(int initialValue)
 
 	setAll(initialValue);
 
+#if CUBE_WORKING_BUFFER
+	pack_dirty_layers();
+#endif
+
 	// Init the layer pins
 	stepLayer(); 
 
@@ -197,58 +473,199 @@ void LEDCube::init(int initialValue)
 
 	// Wait for the first update to be sent to the TLC before starting GSCLK
 	// so that the board doesn't start with random values
-	while(cube_needXLAT);
+	while(cube_needXLAT) { busy_wait(); }
+
+#if CUBE_DOUBLE_BUFFER
+	// Nothing drawn is on show yet, so the first present() needn't wait for a scan
+	cube_midFrame = 0;
+#endif
 
 	// Start the OC for GSCLK
 	OpenOC1(OC_ON | OC_TIMER2_SRC | OC_PWM_FAULT_PIN_DISABLE, 0x1, 0x1);	
 
+#if CUBE_AUTO_REFRESH
+	startRefresh();
+#endif
 }
 
 // Clears Data array. Call call upate() to clear on cube.
 void LEDCube::clearAll(void)
 {
-	for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-		for(int _data = 0; _data < (NUM_TLCS * 6); _data++) {
-			cube_GSData[_layer][_data] = 0x0;
-		}
-	}
+#if CUBE_WORKING_BUFFER
+	memset(cube_WorkData, 0, sizeof(cube_WorkData));
+	cube_dirtyLayers = 0xFFFFFFFF;
+#if CUBE_CURRENT_LIMIT
+	memset(cube_layerSum, 0, sizeof(cube_layerSum));
+	memset(cube_tlcSum, 0, sizeof(cube_tlcSum));
+#endif
+#else
+	memset(cube_GSData, 0, sizeof(cube_GSBuffers[0]));
+#endif
 }
 
 int LEDCube::clearLayer(int layer)
 {
     if((layer < 0) || (layer >= CUBE_SIZE)) return 0;
 
-    for(int _data = 0; _data < (NUM_TLCS * 6); _data++) {
-		cube_GSData[layer][_data] = 0x0;
-	}
+	layer = ring_layer(layer);
+
+#if CUBE_WORKING_BUFFER
+	memset(cube_WorkData[layer], 0, sizeof(cube_WorkData[0]));
+	cube_dirtyLayers |= 1UL << layer;
+#if CUBE_CURRENT_LIMIT
+	cube_layerSum[layer] = 0;
+	memset(cube_tlcSum[layer], 0, sizeof(cube_tlcSum[0]));
+#endif
+#else
+	memset(cube_GSData[layer], 0, sizeof(cube_GSBuffers[0][0]));
+#endif
 
 	return 1;
 }
 
-#if DATA_TRANSFER_MODE == TLC_BITBANG
+/** Moves every layer up by count layers (down if count is negative), the layers 
+    that fall off one end coming back in at the other: what was on layer L is on
+    layer (L + count) % CUBE_SIZE afterwards. Only the base of the layer ring 
+    changes, so this takes the same time for any count and nothing is copied. 
+    With CUBE_DOUBLE_BUFFER or CUBE_WORKING_BUFFER it shows on the next present(),
+    like any other drawing. */
+void LEDCube::rotateLayers(int count)
+{
+	count %= CUBE_SIZE;
+	if (count < 0) count += CUBE_SIZE;
 
-// THIS FUNCTION IS CURRENTLY A BUCKET OF FAAAAAAAAAIL
-int LEDCube::update(void)
+	// Layer L + count now has to find what was in buffer layer L + base
+	int base = cube_layerBase - count;
+	cube_layerBase = (base < 0) ? base + CUBE_SIZE : base;
+}
+
+#if DATA_TRANSFER_MODE == TLC_SPI
+
+// Sends numWords of packed data (a layer or the DC data), blocking until the last 
+// words are in the SPI buffers. With CUBE_SPI_CHAINS 2 the first half, which belongs
+// to the TLCs at the far end, goes out over SPI1 while the second half goes out over
+// SPI2. putcSPIx only waits for room in its own buffer, so taking turns keeps both
+// modules shifting.
+static void spi_send(unsigned int *data, int numWords)
+{
+#if CUBE_SPI_CHAINS == 2
+	numWords >>= 1;
+	for (int i = 0; i < numWords; i++) {
+		putcSPI1(data[i]);
+		putcSPI2(data[numWords + i]);
+	}
+#else
+	putsSPI2(numWords, data);
+#endif
+}
+
+// Waits for the last words of spi_send() to be shifted out
+static void spi_wait(void)
 {
+	while(SpiChnIsBusy(SPI_CHANNEL2));
+#if CUBE_SPI_CHAINS == 2
+	while(SpiChnIsBusy(SPI_CHANNEL1));
+#endif
+}
 
-	for(int i = 0; i < (NUM_TLCS * 6); i++) {
-		for(int s = 31; s >= 0; s--)
-		{
-			if(cube_GSData[currentLayer][i] >> s & 0x1) {
-				PORTGSET |= SOUT;
-			} else {
-				PORTGCLR |= SOUT;
-			}
+#elif DATA_TRANSFER_MODE == TLC_SPI_DMA
 
-			pulse_pin(SCLK_PORT, SCLK);
+// Starts the DMA on numWords of packed data (a layer or the DC data), split over the 
+// SPI modules like spi_send() in TLC_SPI mode. The DMA interrupts count cube_shifting
+// down and the last one requests the XLAT pulse.
+static void dma_send(unsigned int *data, int numWords)
+{
+	cube_shifting = CUBE_SPI_CHAINS;
+
+#if CUBE_SPI_CHAINS == 2
+	numWords >>= 1;
+	DmaChnSetTxfer(CHAIN1_DMA_CHN, data, (void*)&SPI1BUF, numWords * 4, 4, 4);
+	DmaChnStartTxfer(CHAIN1_DMA_CHN, DMA_WAIT_NOT, 0);
+	data += numWords;
+#endif
+
+	DmaChnSetTxfer(GS_DMA_CHN, data, (void*)&SPI2BUF, numWords * 4, 4, 4);
+	DmaChnStartTxfer(GS_DMA_CHN, DMA_WAIT_NOT, 0);
+}
+
+#elif DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+
+// Transposes a 32x32 bit matrix in place: bit 31 - j of a[i] swaps with bit 31 - i 
+// of a[j]. Swaps the 16x16 blocks, then the 8x8 blocks inside them and so on down to 
+// single bits: 5 passes of 16 swaps instead of 1024 single bit moves.
+static void transpose32(unsigned int *a)
+{
+	unsigned int m = 0x0000FFFF;
+
+	for (int j = 16; j != 0; j >>= 1, m ^= m << j) {
+		for (int k = 0; k < 32; k = (k + j + 1) & ~j) {
+			unsigned int t = (a[k] ^ (a[k + j] >> j)) & m;
+			a[k] ^= t;
+			a[k + j] ^= t << j;
+		}
+	}
+}
+
+// Bit-bangs numWords of packed data (a layer or the DC data) into SIN_CHAINS chains 
+// at once. The data is split into SIN_CHAINS equal runs and, like with 
+// CUBE_SPI_CHAINS, the first run belongs to the TLCs at the far end, so chain n gets 
+// run SIN_CHAINS - 1 - n. Word i of every run goes into one 32x32 matrix, which 
+// transposed gives the 32 port values (one bit per chain) for the next 32 SCLKs.
+static void parallel_send(const unsigned int *data, int numWords)
+{
+	int chainWords = numWords / SIN_CHAINS;
+	unsigned int slices[32];
+	unsigned int pins = SIN_PORT & SIN_MASK;
+
+	for (int i = 0; i < chainWords; i++) {
+		// Row 31 - n is chain n's word, the rows of missing chains stay 0
+		for (int n = 0; n < 32; n++) {
+			slices[31 - n] = (n < SIN_CHAINS) ? data[(SIN_CHAINS - 1 - n) * chainWords + i] : 0;
+		}
+		transpose32(slices);
+
+		// Only toggle the SIN pins that change, so the rest of the port is left alone
+		for (int s = 0; s < 32; s++) {
+			unsigned int next = slices[s] << SIN_SHIFT;
+			SIN_PORTINV = pins ^ next;
+			pins = next;
+
+			SCLK_PORTSET = SCLK;
+			SCLK_PORTCLR = SCLK;
 		}
 	}
+}
+
+#endif
+
+
+#if DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+
+int LEDCube::update(void)
+{
+	// We CANNOT use SOUT/SCLK while XLAT is high - tampering with the data while it's being latched is a BAD idea
+	if (cube_needXLAT){
+		return 1; 
+	}
+
+	parallel_send(front_layer(currentLayer), NUM_TLCS * 6);
 
 	request_xlat_pulse();
 
 	return 0;
 }
 
+int LEDCube::startUpdate(void)
+{
+	return update();
+}
+
+// Nothing to wait for here; stepLayer() holds the new layer off until XLAT
+void LEDCube::finishUpdate(void)
+{
+	stepLayer();
+}
+
 #elif DATA_TRANSFER_MODE == TLC_SPI
 
 int LEDCube::update(void)
@@ -259,11 +676,11 @@ int LEDCube::update(void)
 	}
 	pulse_pin(SCLK_PORT, SCLK);
 
-	//TODO use Interrupt driven SPI for a non-blocking performance boost - this could get tricky when mixed with DC updates
-	putsSPI2(6 * NUM_TLCS, cube_GSData[currentLayer]);
+	// Blocks until the data is out. DATA_TRANSFER_MODE TLC_SPI_DMA sends it in the background instead
+	spi_send(front_layer(currentLayer), 6 * NUM_TLCS);
 
 	// Wait for buffers to be emptied
-	while(SpiChnIsBusy(SPI_CHANNEL2));
+	spi_wait();
 
 	request_xlat_pulse();
 
@@ -278,8 +695,8 @@ int LEDCube::startUpdate(void)
 	}
 	pulse_pin(SCLK_PORT, SCLK);
 
-	//TODO use Interrupt driven SPI for a non-blocking performance boost - this could get tricky when mixed with DC updates
-	putsSPI2(6 * NUM_TLCS, cube_GSData[currentLayer]);
+	// Only fills the SPI buffer, finishUpdate() waits for the rest
+	spi_send(front_layer(currentLayer), 6 * NUM_TLCS);
 
 	return 0;
 }
@@ -287,7 +704,7 @@ int LEDCube::startUpdate(void)
 void LEDCube::finishUpdate(void)
 {
 	// Wait for buffers to be emptied
-	while(SpiChnIsBusy(SPI_CHANNEL2));
+	spi_wait();
 
 	//stepLayerFlag = 1;
 
@@ -297,6 +714,87 @@ void LEDCube::finishUpdate(void)
 	stepLayer();
 }
 
+#elif DATA_TRANSFER_MODE == TLC_SPI_DMA
+
+// Points the DMA channel(s) at a layer of the front buffer and starts them
+static void send_layer(int layer)
+{
+	// Flag the update straight away so that nobody starts another one while the DMA is running
+	cube_needXLAT = 1;
+
+	dma_send(front_layer(layer), NUM_TLCS * 6);
+}
+
+// Starts sending the current layer and returns straight away. The DMA interrupt
+// requests the XLAT pulse once the last word is handed to SPI2.
+int LEDCube::update(void)
+{
+	// We CANNOT use SOUT/SCLK while XLAT is high - tampering with the data while it's being latched is a BAD idea
+	// The refresh engine sends the layers itself while it runs
+	if (cube_needXLAT || cube_refreshState){
+		return 1; 
+	}
+	pulse_pin(SCLK_PORT, SCLK);
+
+	send_layer(currentLayer);
+
+	return 0;
+}
+
+int LEDCube::startUpdate(void)
+{
+	return update();
+}
+
+// Nothing to wait for here; stepLayer() holds the new layer off until XLAT
+void LEDCube::finishUpdate(void)
+{
+	stepLayer();
+}
+
+/** Hands the layer multiplexing over to the interrupts. From here on every XLAT 
+    switches the layer pins over to the layer that was just latched and starts 
+    sending the next one, and the BLANK interrupt holds each layer for 
+    CUBE_LAYER_CYCLES GS cycles before asking for the next XLAT. loop() only needs 
+    to draw (and present() with CUBE_DOUBLE_BUFFER); update(), startUpdate() and
+    stepLayer() do nothing until stopRefresh(). updateDC() queues the DC for the 
+    engine to send between two layers, and updateInProgress() stays 1 until it 
+    has been latched, so while (Cube.updateInProgress()); still waits for it. 
+    init() calls this when CUBE_AUTO_REFRESH is set. */
+void LEDCube::startRefresh(void)
+{
+	if (cube_refreshState == REFRESH_RUNNING) return;
+
+	// Let a manual update, or the last layer of a stopping refresh, finish first
+	while(cube_needXLAT || cube_refreshState) { busy_wait(); }
+
+	cube_heldCycles = 0;
+	cube_refreshState = REFRESH_RUNNING;
+
+	// The BLANK interrupt stays on while the engine runs, to count the GS cycles
+	ConfigIntOC5(OC_INT_ON | OC_INT_PRIOR_3 | OC_INT_SUB_PRI_3);
+
+	send_layer(currentLayer);
+}
+
+/** Stops the refresh engine once the layer it has already sent is latched and lit, 
+    and waits for that to happen. That layer stays on until the next finishUpdate(), 
+    which carries on the manual scan from getCurrentLayer(). */
+void LEDCube::stopRefresh(void)
+{
+	if (cube_refreshState == REFRESH_RUNNING) {
+		cube_refreshState = REFRESH_STOPPING;
+	}
+
+	while(cube_refreshState) { busy_wait(); }
+}
+
+// Returns 1 while the refresh engine is scanning the layers
+int LEDCube::refreshRunning(void)
+{
+	return cube_refreshState != REFRESH_OFF;
+}
+
 #endif
 // End of Data XFER TLC_SPI
 
@@ -314,85 +812,67 @@ int LEDCube::getNextLayer(void) {
 	return nextLayer;
 }
 
-void LEDCube::stepLayer(void)
+// Turns a layer off: its pin goes to an input and is pulled high
+static void layer_off(int layer)
 {
-   switch (currentLayer) {
-      case 0:
-      	HIGHEST_LAYER_TRIS |= HIGHEST_LAYER; // Turn Last layer to input
-      	HIGHEST_LAYER_PORT |= HIGHEST_LAYER; // Pull last layer high
-
-      	while(cube_needXLAT) { };
-
-        LAYER0_TRIS &= ~(LAYER0); // Turn the first layer pin(26) to an output 
-        LAYER0_PORT &= ~(LAYER0); // Pull first layer pin low
-        break;
-      case 1:
-      	LAYER0_TRIS |= LAYER0;
-      	LAYER0_PORT |= LAYER0;
-
-      	while(cube_needXLAT) { };
-
-        LAYER1_TRIS &= ~(LAYER1); 
-        LAYER1_PORT &= ~(LAYER1);
-        break;
-      case 2:
-        LAYER1_TRIS |= LAYER1;
-      	LAYER1_PORT |= LAYER1;
-
-      	while(cube_needXLAT) { };
-
-        LAYER2_TRIS &= ~(LAYER2);
-        LAYER2_PORT &= ~(LAYER2);
-        break;
-      case 3:
-        LAYER2_TRIS |= LAYER2;
-      	LAYER2_PORT |= LAYER2;
-
-      	while(cube_needXLAT) { };
+	switch (layer) {
+		case 0: LAYER0_TRIS |= LAYER0; LAYER0_PORT |= LAYER0; break;
+		case 1: LAYER1_TRIS |= LAYER1; LAYER1_PORT |= LAYER1; break;
+		case 2: LAYER2_TRIS |= LAYER2; LAYER2_PORT |= LAYER2; break;
+		case 3: LAYER3_TRIS |= LAYER3; LAYER3_PORT |= LAYER3; break;
+		case 4: LAYER4_TRIS |= LAYER4; LAYER4_PORT |= LAYER4; break;
+		case 5: LAYER5_TRIS |= LAYER5; LAYER5_PORT |= LAYER5; break;
+		case 6: LAYER6_TRIS |= LAYER6; LAYER6_PORT |= LAYER6; break;
+		case 7: LAYER7_TRIS |= LAYER7; LAYER7_PORT |= LAYER7; break;
+	}
+}
 
-        LAYER3_TRIS &= ~(LAYER3);
-        LAYER3_PORT &= ~(LAYER3); 
-        break;
-      case 4:
-        LAYER3_TRIS |= LAYER3;
-      	LAYER3_PORT |= LAYER3;
+// Turns a layer on: its pin goes to an output and is pulled low
+static void layer_on(int layer)
+{
+	switch (layer) {
+		case 0: LAYER0_TRIS &= ~(LAYER0); LAYER0_PORT &= ~(LAYER0); break;
+		case 1: LAYER1_TRIS &= ~(LAYER1); LAYER1_PORT &= ~(LAYER1); break;
+		case 2: LAYER2_TRIS &= ~(LAYER2); LAYER2_PORT &= ~(LAYER2); break;
+		case 3: LAYER3_TRIS &= ~(LAYER3); LAYER3_PORT &= ~(LAYER3); break;
+		case 4: LAYER4_TRIS &= ~(LAYER4); LAYER4_PORT &= ~(LAYER4); break;
+		case 5: LAYER5_TRIS &= ~(LAYER5); LAYER5_PORT &= ~(LAYER5); break;
+		case 6: LAYER6_TRIS &= ~(LAYER6); LAYER6_PORT &= ~(LAYER6); break;
+		case 7: LAYER7_TRIS &= ~(LAYER7); LAYER7_PORT &= ~(LAYER7); break;
+	}
+}
 
-      	while(cube_needXLAT) { };
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+// Switches the layer pins from the layer before currentLayer over to currentLayer
+// and moves currentLayer on. Called by the refresh engine once the data for 
+// currentLayer is latched.
+static void show_current_layer(void)
+{
+	int previousLayer = (currentLayer == 0) ? CUBE_SIZE - 1 : currentLayer - 1;
 
-        LAYER4_TRIS &= ~(LAYER4);
-        LAYER4_PORT &= ~(LAYER4);
-        break;
-      case 5:
-        LAYER4_TRIS |= LAYER4;
-      	LAYER4_PORT |= LAYER4;
+	layer_off(previousLayer);
+	layer_on(currentLayer);
 
-      	while(cube_needXLAT) { };
+	currentLayer++;
+	if(currentLayer == CUBE_SIZE) currentLayer = 0;
+}
+#endif
 
-        LAYER5_TRIS &= ~(LAYER5);
-        LAYER5_PORT &= ~(LAYER5);
-        break;
-      case 6:
-        LAYER5_TRIS |= LAYER5;
-      	LAYER5_PORT |= LAYER5;
+void LEDCube::stepLayer(void)
+{
+	// The refresh engine owns the layer pins while it runs
+	if (cube_refreshState) return;
 
-      	while(cube_needXLAT) { };
+	int previousLayer = (currentLayer == 0) ? CUBE_SIZE - 1 : currentLayer - 1;
 
-        LAYER6_TRIS &= ~(LAYER6);
-        LAYER6_PORT &= ~(LAYER6);
-        break;
-      case 7:
-        LAYER6_TRIS |= LAYER6;
-      	LAYER6_PORT |= LAYER6;
+	layer_off(previousLayer);
 
-      	while(cube_needXLAT) { };
+	while(cube_needXLAT) { busy_wait(); }
 
-        LAYER7_TRIS &= ~(LAYER7);
-        LAYER7_PORT &= ~(LAYER7);
-        break;
-    }
+	layer_on(currentLayer);
 
-    currentLayer++;
-    if(currentLayer == CUBE_SIZE) currentLayer = 0;
+	currentLayer++;
+	if(currentLayer == CUBE_SIZE) currentLayer = 0;
 
 
   // TRISE |= 0xFF; // Turn layer pins to inputs
@@ -442,6 +922,390 @@ void LEDCube::stepLayer(void)
 
 
 
+/** Grayscale values are 12 bits; anything bigger is clamped to 4095 */
+static inline unsigned int clamp12(unsigned int value)
+{
+	return (value > 4095) ? 4095 : value;
+}
+
+/** Packs 8 channels into the 3 words that hold them. v[0] is the lowest of the
+    8 channels, which is stored last (case H), so this is the picture in set()
+    with all 8 cases done at once:
+      w[0] = |A|A|A|B|B|B|C|C|   w[1] = |C|D|D|D|E|E|E|F|   w[2] = |F|F|G|G|G|H|H|H| */
+static inline void pack8(unsigned int *w, const uint16_t *v)
+{
+	unsigned int v0 = clamp12(v[0]), v1 = clamp12(v[1]), v2 = clamp12(v[2]), v3 = clamp12(v[3]);
+	unsigned int v4 = clamp12(v[4]), v5 = clamp12(v[5]), v6 = clamp12(v[6]), v7 = clamp12(v[7]);
+
+	w[0] = v7 << 20 | v6 << 8 | v5 >> 4;
+	w[1] = v5 << 28 | v4 << 16 | v3 << 4 | v2 >> 8;
+	w[2] = v2 << 24 | v1 << 12 | v0;
+}
+
+/** The reverse of pack8() */
+static inline void unpack8(const unsigned int *w, uint16_t *v)
+{
+	v[7] = (w[0] >> 20) & 0xFFF;
+	v[6] = (w[0] >> 8) & 0xFFF;
+	v[5] = ((w[0] << 4) & 0xFF0) | (w[1] >> 28);
+	v[4] = (w[1] >> 16) & 0xFFF;
+	v[3] = (w[1] >> 4) & 0xFFF;
+	v[2] = ((w[1] << 8) & 0xF00) | (w[2] >> 24);
+	v[1] = (w[2] >> 12) & 0xFFF;
+	v[0] = w[2] & 0xFFF;
+}
+
+#if CUBE_CURRENT_LIMIT
+/** Keeps the sums up to date as channel of buffer layer ring goes from old to value */
+static inline void track_value(int ring, int channel, int old, int value)
+{
+	cube_layerSum[ring] += value - old;
+	cube_tlcSum[ring][channel >> 4] += value - old;
+}
+
+/** Works the sums of buffer layer ring out again from its values */
+static void sum_layer(int ring)
+{
+	cube_layerSum[ring] = 0;
+
+	for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+		unsigned int sum = 0;
+		for (int i = 0; i < 16; i++) {
+			sum += clamp12(cube_WorkData[ring][tlc * 16 + i]);
+		}
+		cube_tlcSum[ring][tlc] = sum;
+		cube_layerSum[ring] += sum;
+	}
+}
+
+/** Q16 scale that brings buffer layer ring within the budgets, 0x10000 if it is */
+static unsigned int layer_scale(int ring)
+{
+	unsigned int scale = 0x10000;
+
+#if CUBE_LAYER_BUDGET_MA
+	const uint32_t layerBudget = (uint32_t)CUBE_LAYER_BUDGET_MA * 4095 / CUBE_CHANNEL_MA;
+	if (cube_layerSum[ring] > layerBudget) {
+		scale = ((uint64_t)layerBudget << 16) / cube_layerSum[ring];
+	}
+#endif
+
+#if CUBE_TLC_BUDGET_MA
+	const uint32_t tlcBudget = (uint32_t)CUBE_TLC_BUDGET_MA * 4095 / CUBE_CHANNEL_MA;
+	unsigned int highest = 0;
+	for (int tlc = 0; tlc < NUM_TLCS; tlc++) {
+		if (cube_tlcSum[ring][tlc] > highest) highest = cube_tlcSum[ring][tlc];
+	}
+	if ((highest > tlcBudget) && (((uint64_t)tlcBudget << 16) / highest < scale)) {
+		scale = ((uint64_t)tlcBudget << 16) / highest;
+	}
+#endif
+
+	return scale;
+}
+#else
+static inline void track_value(int /* ring */, int /* channel */, int /* old */, int /* value */) {}
+#endif
+
+#if !CUBE_WORKING_BUFFER
+/** Packs a whole layer in which channel c holds colors[c % period], for a period
+    of 1 (one value everywhere) or 3 (B,G,R of sequentially wired RGB LEDs).
+    mask gets the bits of every channel whose value is valid (0-4095), so that
+    invalid values leave the channel alone the way set() does.
+    Either pattern repeats every 24 channels, which is 3 groups of 8 or 9 words, 
+    so only 3 groups are packed and the rest of the layer is copied from them. */
+static void build_pattern(unsigned int *words, unsigned int *mask, const int *colors, int period)
+{
+	uint16_t values[24];
+	uint16_t valid[24];
+
+	for (int i = 0; i < 24; i++) {
+		int value = colors[i % period];
+		int ok = (value >= 0) && (value <= 4095);
+
+		values[i] = ok ? value : 0;
+		valid[i] = ok ? 0xFFF : 0;
+	}
+
+	unsigned int tile[3][3];
+	unsigned int tileMask[3][3];
+
+	for (int g = 0; g < 3; g++) {
+		pack8(tile[g], values + 8 * g);
+		pack8(tileMask[g], valid + 8 * g);
+	}
+
+	// Group g of the layer looks like group g % 3 of the tile
+	for (int g = 0; g < NUM_TLCS * 2; g++) {
+		unsigned int *w = words + 3 * (NUM_TLCS * 2 - 1 - g);
+		unsigned int *m = mask + 3 * (NUM_TLCS * 2 - 1 - g);
+
+		w[0] = tile[g % 3][0]; w[1] = tile[g % 3][1]; w[2] = tile[g % 3][2];
+		m[0] = tileMask[g % 3][0]; m[1] = tileMask[g % 3][1]; m[2] = tileMask[g % 3][2];
+	}
+}
+
+/** Copies channels firstChannel to firstChannel + count - 1 of a packed layer
+    (words, under mask) into dst. Channel c is the 12 bits that start
+    12 * (NUM_TLCS * 16 - 1 - c) bits into the layer, counting from the MSB of
+    the first word, so the span is one run of bits: the words in the middle are
+    stored whole and only the two words at its ends need their edges masked. */
+static void fill_span(unsigned int *dst, const unsigned int *words, const unsigned int *mask, int firstChannel, int count)
+{
+	int startBit = 12 * (NUM_TLCS * 16 - firstChannel - count);
+	int endBit = 12 * (NUM_TLCS * 16 - firstChannel);
+
+	int w = startBit >> 5;
+	int lastWord = (endBit - 1) >> 5;
+
+	unsigned int headMask = 0xFFFFFFFF >> (startBit & 31);
+	unsigned int tailMask = (endBit & 31) ? ~(0xFFFFFFFF >> (endBit & 31)) : 0xFFFFFFFF;
+	unsigned int m;
+
+	if (w == lastWord) {
+		m = mask[w] & headMask & tailMask;
+		dst[w] = (dst[w] & ~m) | (words[w] & m);
+		return;
+	}
+
+	m = mask[w] & headMask;
+	dst[w] = (dst[w] & ~m) | (words[w] & m);
+
+	for (w++; w < lastWord; w++) {
+		dst[w] = (dst[w] & ~mask[w]) | words[w];
+	}
+
+	m = mask[w] & tailMask;
+	dst[w] = (dst[w] & ~m) | (words[w] & m);
+}
+
+/** Copies n bits of src, starting srcBit bits in (counted from the MSB of 
+    src[0]), to dst starting dstBit bits in. Each destination word is written 
+    once: the source bits are funnel-shifted from the two words they straddle
+    and masked into place. src and dst must not overlap. */
+static void copy_bits(unsigned int *dst, int dstBit, const unsigned int *src, int srcBit, int n)
+{
+	while (n > 0) {
+		int d = dstBit & 31;
+		int s = srcBit & 31;
+		int take = (n < 32 - d) ? n : 32 - d;
+		const unsigned int *w = src + (srcBit >> 5);
+
+		// The take bits from srcBit on, at the top of the word. w[1] is only read
+		// when the bits go into it, so a run can end on the last word of src.
+		unsigned int bits = (s + take > 32) ? (w[0] << s) | (w[1] >> (32 - s)) : w[0] << s;
+		unsigned int mask = (0xFFFFFFFF << (32 - take)) >> d;
+
+		dst[dstBit >> 5] = (dst[dstBit >> 5] & ~mask) | ((bits >> d) & mask);
+
+		dstBit += take;
+		srcBit += take;
+		n -= take;
+	}
+}
+
+/** Clears n bits of dst, starting dstBit bits in */
+static void clear_bits(unsigned int *dst, int dstBit, int n)
+{
+	while (n > 0) {
+		int d = dstBit & 31;
+		int take = (n < 32 - d) ? n : 32 - d;
+
+		dst[dstBit >> 5] &= ~((0xFFFFFFFF << (32 - take)) >> d);
+
+		dstBit += take;
+		n -= take;
+	}
+}
+
+/** Moves the bits from startBit to endBit - 1 of a packed layer by shift bits
+    (0 < |shift| < endBit - startBit): towards the MSB of the first word if shift
+    is positive, towards the end of the layer if it is negative. The bits pushed
+    out of one end come back in at the other if wrap is set; otherwise zeros come
+    in. Only the words the span covers are saved first, so it costs about two
+    word operations per word of the span. */
+static void shift_bits(unsigned int *words, int startBit, int endBit, int shift, int wrap)
+{
+	unsigned int old[NUM_TLCS * 6];
+	int firstWord = startBit >> 5;
+	int length = endBit - startBit;
+	int from = startBit & 31;	// where the span starts in old
+
+	memcpy(old, words + firstWord, (((endBit - 1) >> 5) - firstWord + 1) * sizeof(unsigned int));
+
+	if (shift > 0) {
+		copy_bits(words, startBit, old, from + shift, length - shift);
+		if (wrap) {
+			copy_bits(words, endBit - shift, old, from, shift);
+		} else {
+			clear_bits(words, endBit - shift, shift);
+		}
+	} else {
+		shift = -shift;
+		copy_bits(words, startBit + shift, old, from, length - shift);
+		if (wrap) {
+			copy_bits(words, startBit, old, from + length - shift, shift);
+		} else {
+			clear_bits(words, startBit, shift);
+		}
+	}
+}
+
+#endif
+
+/** Sets rows spans of count channels on layers firstLayer to lastLayer to a 
+    repeating colour (see build_pattern()). Row r starts at channel 
+    firstChannel + r * rowStride. The pattern is packed once and every row is 
+    then stamped into the packed words with fill_span(), so a box costs about a
+    word store per 32 bits it covers. Each row is clipped to the chain, or to
+    the last whole LED of it if period is 3. */
+static void fill_rows(int firstLayer, int lastLayer, int firstChannel, int count, int rows, int rowStride, const int *colors, int period)
+{
+	const int endChannel = NUM_TLCS * 16 - (NUM_TLCS * 16) % period;
+
+#if !CUBE_WORKING_BUFFER
+	unsigned int words[NUM_TLCS * 6];
+	unsigned int mask[NUM_TLCS * 6];
+	build_pattern(words, mask, colors, period);
+#endif
+
+	for (int row = 0; row < rows; row++) {
+		int first = firstChannel + row * rowStride;
+		int n = count;
+
+		if (first < 0) {
+			n += first;
+			first = 0;
+		}
+		if (n > endChannel - first) {
+			n = endChannel - first;
+		}
+		if (n <= 0) continue;
+
+		for (int layer = firstLayer; layer <= lastLayer; layer++) {
+#if CUBE_WORKING_BUFFER
+			int ring = ring_layer(layer);
+			uint16_t *values = cube_WorkData[ring];
+			int phase = first % period;
+
+			for (int channel = first; channel < first + n; channel++) {
+				int value = colors[phase];
+				if ((value >= 0) && (value <= 4095)) {
+					track_value(ring, channel, values[channel], value);
+					values[channel] = value;
+				}
+				if (++phase == period) phase = 0;
+			}
+			cube_dirtyLayers |= 1UL << ring;
+#else
+			fill_span(cube_GSData[ring_layer(layer)], words, mask, first, n);
+#endif
+		}
+	}
+}
+
+/** Sets a span of channels on layers firstLayer to lastLayer to a repeating
+    colour. The span is clipped to the chain. */
+static void fill_layers(int firstLayer, int lastLayer, int firstChannel, int count, const int *colors, int period)
+{
+	fill_rows(firstLayer, lastLayer, firstChannel, count, 1, 0, colors, period);
+}
+
+#if CUBE_WORKING_BUFFER
+/** Packs every layer of #cube_WorkData that changed since the last call into
+    #cube_GSData, 8 channels at a time */
+static void pack_dirty_layers(void)
+{
+	for (int layer = 0; layer < CUBE_SIZE; layer++) {
+		if (!(cube_dirtyLayers & (1UL << layer))) continue;
+
+#if CUBE_CURRENT_LIMIT
+		// Only a layer that changed can have gone over the budget
+		unsigned int scale = layer_scale(layer);
+#endif
+
+		// Group g (channels 8g to 8g+7) lives in words 3 * (NUM_TLCS * 2 - 1 - g) onwards
+		for (int g = 0; g < NUM_TLCS * 2; g++) {
+#if CUBE_GAMMA_ENABLED || CUBE_CURRENT_LIMIT
+			// A multiply for the budget and/or one for the brightness and a table
+			// lookup per channel
+			const uint16_t *values = cube_WorkData[layer] + 8 * g;
+			uint16_t corrected[8];
+
+			for (int i = 0; i < 8; i++) {
+				unsigned int value = clamp12(values[i]);
+#if CUBE_CURRENT_LIMIT
+				value = (value * scale) >> 16;
+#endif
+#if CUBE_GAMMA_ENABLED
+				value = cube_gammaTable[(value * (cube_brightness + 1)) >> 8];
+#endif
+				corrected[i] = value;
+			}
+			pack8(cube_GSData[layer] + 3 * (NUM_TLCS * 2 - 1 - g), corrected);
+#else
+			pack8(cube_GSData[layer] + 3 * (NUM_TLCS * 2 - 1 - g), cube_WorkData[layer] + 8 * g);
+#endif
+		}
+	}
+
+	cube_dirtyLayers = 0;
+}
+
+/** The working buffer of a layer, for effects that want to work on the values
+    directly: NUM_CHANNELS values of 0-4095, channel 0 first. Call
+    setLayerDirty() after changing it so that present() packs it. */
+uint16_t* LEDCube::getWorkData(int layer)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return 0;
+
+	return cube_WorkData[ring_layer(layer)];
+}
+
+void LEDCube::setLayerDirty(int layer)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
+
+	cube_dirtyLayers |= 1UL << ring_layer(layer);
+#if CUBE_CURRENT_LIMIT
+	// The values were changed behind the sums' back
+	sum_layer(ring_layer(layer));
+#endif
+}
+#endif
+
+#if CUBE_CURRENT_LIMIT
+/** Current layer would draw while it is lit, in mA, before any scaling for the
+    budgets. Comes from the running sums, so it costs nothing to ask. */
+int LEDCube::getLayerCurrent(int layer)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return 0;
+
+	return (uint64_t)cube_layerSum[ring_layer(layer)] * CUBE_CHANNEL_MA / 4095;
+}
+
+/** Same for the 16 channels of one TLC on layer */
+int LEDCube::getTLCCurrent(int layer, int tlc)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return 0;
+	if ((tlc < 0) || (tlc >= NUM_TLCS)) return 0;
+
+	return (uint32_t)cube_tlcSum[ring_layer(layer)][tlc] * CUBE_CHANNEL_MA / 4095;
+}
+#endif
+
+#if CUBE_GAMMA_ENABLED
+/** Sets the brightness (0-255, 255 is full) that every value is scaled by
+    before the gamma table. Every layer is packed again on the next present(). */
+void LEDCube::setBrightness(int brightness)
+{
+	if ((brightness < 0) || (brightness > 255)) return;
+
+	cube_brightness = brightness;
+	cube_dirtyLayers = 0xFFFFFFFF;
+}
+#endif
+
 /** Sets channel to value in the grayscale data array, #cube_GSData.
     \param channel (0 to #NUM_TLCS * 16 - 1).  OUT0 of the first TLC is
            channel 0, OUT0 of the next TLC is channel 16, etc.
@@ -453,151 +1317,425 @@ void LEDCube::set(int layer, int channel, int value)
 	if ((channel < 0) || (channel >= NUM_TLCS*16)) return;
 	if ((value < 0) || (value > 4095)) return;
 
-	// Data is packed into cube_GSData as pictured below. 
-	// Each letter represents 4 bits and the last channel is stored first. 
-	// So |A|A|A| would be the 12-bit value of the last TLC channel
-	// 
-	// As picture below, there are 8 possible positions for the 12-bit value to be stored in the array (Cases A-H)
-	//	               ________________________________________________
-	//  Channel data: |A|A|A|B|B|B|C|C|C|D|D|D|E|E|E|F|F|F|G|G|G|H|H|H|
-	// 32-bit borders |‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|
+	layer = ring_layer(layer);
+
+#if CUBE_WORKING_BUFFER
+	// present() packs it
+	track_value(layer, channel, cube_WorkData[layer][channel], value);
+	cube_WorkData[layer][channel] = value;
+	cube_dirtyLayers |= 1UL << layer;
+#else
+	CubeLayerChain::pack(cube_GSData[layer], channel, value);
+#endif
+}
+
+// Packs the first layer once and copies it to the others
+void LEDCube::setAll(int value){
+	if ((value < 0) || (value > 4095)) return;
+
+#if CUBE_WORKING_BUFFER
+	fill_layers(0, CUBE_SIZE - 1, 0, NUM_TLCS * 16, &value, 1);
+#else
+	unsigned int mask[NUM_TLCS * 6];
+	build_pattern(cube_GSData[0], mask, &value, 1);
+
+	for(int _layer = 1; _layer < CUBE_SIZE; _layer++) {
+		memcpy(cube_GSData[_layer], cube_GSData[0], sizeof(cube_GSBuffers[0][0]));
+	}
+#endif
+}
+
+int LEDCube::getNumTLCs() {
+	return NUM_TLCS;
+}
+
+
+int LEDCube::get(int layer, int channel) {
+
+	layer = ring_layer(layer);
+
+#if CUBE_WORKING_BUFFER
+	return cube_WorkData[layer][channel];
+#else
+	return CubeLayerChain::unpack(cube_GSData[layer], channel);
+#endif
+}
 
+/** Sets count channels, starting at firstChannel, from values[0..count-1].
+    Whole groups of 8 channels (0-7, 8-15, ...) are packed straight into
+    #cube_GSData[layer] three words at a time; only the channels at either
+    end that don't fill a group go through set(). Nothing happens for a layer
+    outside the cube, channels outside the chain are skipped and values above
+    4095 are clamped.
+    \see getRange */
+void LEDCube::setRange(int layer, int firstChannel, const uint16_t *values, int count)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
 
+	// Clip the range to the chain
+	if (firstChannel < 0) {
+		values -= firstChannel;
+		count += firstChannel;
+		firstChannel = 0;
+	}
+	if (count > NUM_TLCS * 16 - firstChannel) {
+		count = NUM_TLCS * 16 - firstChannel;
+	}
+	if (count <= 0) return;
 
-	// Since the last channel is stored first in the array, index32 is used as the inverse of channel
-	// i.e. assuming NUM_TLCs = 1, when channel = 15, then index32 = 0 and when channel = 0, then index32 = 15
-	unsigned int index32 = (NUM_TLCS * 16 - 1) - channel;
+#if CUBE_WORKING_BUFFER
+	int ring = ring_layer(layer);
+	for (int i = 0; i < count; i++) {
+		track_value(ring, firstChannel + i, cube_WorkData[ring][firstChannel + i], clamp12(values[i]));
+		cube_WorkData[ring][firstChannel + i] = clamp12(values[i]);
+	}
+	cube_dirtyLayers |= 1UL << ring;
+	return;
+#endif
 
-	// index12p = index32 * 3 / 8 = the index into cube_GSData where a 32-bit elment exists that will hold our 12-bit value
-	unsigned int *index12p = cube_GSData[layer] + ((index32 * 3) >> 3);
+	int channel = firstChannel;
+	int lastChannel = firstChannel + count;
 
-	// caseNum  = index32 mod 8 = which of the 8 possible cases we need to handle
-	int caseNum = index32 % 8;
+	// Leading channels up to the first group boundary
+	while ((channel & 7) && (channel < lastChannel)) {
+		set(layer, channel, clamp12(*values++));
+		channel++;
+	}
 
-	switch(caseNum){
-		case 0:	// A: 12 bits start at the beginning of the element
+	// Group g (channels 8g to 8g+7) lives in words 3 * (NUM_TLCS * 2 - 1 - g) onwards,
+	// so the groups are walked backwards through the array
+	while (channel + 8 <= lastChannel) {
+		pack8(cube_GSData[ring_layer(layer)] + 3 * (NUM_TLCS * 2 - 1 - (channel >> 3)), values);
+		values += 8;
+		channel += 8;
+	}
 
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0x000FFFFF) | value << 20;
-			break;
-		case 1:	// B: 12 bits start 12 bits into the element
+	// Whatever is left of the last group
+	while (channel < lastChannel) {
+		set(layer, channel, clamp12(*values++));
+		channel++;
+	}
+}
 
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xFFF000FF) | value << 8;
-			break;
-		case 2:	// C: 12 bits start 24 bits into the element and continue 4 bits into the next
+/** Reads count channels, starting at firstChannel, into values[0..count-1].
+    Channels outside the chain, or a layer outside the cube, are skipped,
+    leaving their values alone.
+    \see setRange */
+void LEDCube::getRange(int layer, int firstChannel, uint16_t *values, int count)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
 
-			// zero out the 8 bits that are in this element and OR them with the 8 MSB bits of value
-			*index12p = (*index12p & 0xFFFFFF00) | value >> 4;
+	if (firstChannel < 0) {
+		values -= firstChannel;
+		count += firstChannel;
+		firstChannel = 0;
+	}
+	if (count > NUM_TLCS * 16 - firstChannel) {
+		count = NUM_TLCS * 16 - firstChannel;
+	}
+	if (count <= 0) return;
 
-			// move to the next element, and zero out the remaining 4 bits, then OR them with the remaining 4 bits of value
-			index12p++;
-			*index12p = (*index12p & 0x0FFFFFFF) | value << 28;
-			break;
-		case 3:	// D: 12 bits start 4 bits into the element
+#if CUBE_WORKING_BUFFER
+	memcpy(values, cube_WorkData[ring_layer(layer)] + firstChannel, count * sizeof(uint16_t));
+	return;
+#endif
 
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xF000FFFF) | value << 16; 			
-			break;
-		case 4: // E: 12 bits start 16 bits into the element
+	int channel = firstChannel;
+	int lastChannel = firstChannel + count;
 
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xFFFF000F) | value << 4;
-			break;
-		case 5:	// F: 12 bits start 28 bits into the element and continue 8 bits into the next
+	while ((channel & 7) && (channel < lastChannel)) {
+		*values++ = get(layer, channel++);
+	}
 
-			// set the 4 bits that apply to this element
-			*index12p = (*index12p & 0xFFFFFFF0) | value >> 8;
+	while (channel + 8 <= lastChannel) {
+		unpack8(cube_GSData[ring_layer(layer)] + 3 * (NUM_TLCS * 2 - 1 - (channel >> 3)), values);
+		values += 8;
+		channel += 8;
+	}
 
-			// move to the next element, and set the appropriate bits
-			index12p++;
-			*index12p = (*index12p & 0x00FFFFFF) | value << 24;
-			break;
-		case 6:	// G: 12 bits start 8 bits into the element
-			*index12p = (*index12p & 0xFF000FFF) | value << 12;
-			break;
-		case 7:	// H: 12 bits start 20 bits into the element
-			*index12p = (*index12p & 0xFFFFF000) | value;
-			break;
+	while (channel < lastChannel) {
+		*values++ = get(layer, channel++);
 	}
 }
 
-// There is most certainly a faster way to do this, but this will work for now
-void LEDCube::setAll(int value){
-	for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-		for (int _data = 0; _data < NUM_TLCS * 6; _data++){
-		       set(_layer, _data, value);
+/** Moves channels firstChannel to firstChannel + count - 1 of a layer by shift
+    channels: what was on channel c ends up on c + shift. The channels left 
+    empty at one end are cleared, or, if wrap is set, get the channels pushed 
+    out of the other end. In the packed data the span is one run of bits 
+    (see fill_span()), so this is a funnel shift of that run by 12 * shift bits,
+    a couple of word operations per 32 bits instead of a get() and set() for 
+    every channel. Nothing happens if the span isn't all on the chain. */
+void LEDCube::shiftChannels(int layer, int firstChannel, int count, int shift, int wrap)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
+	if ((firstChannel < 0) || (count <= 0) || (count > NUM_TLCS * 16 - firstChannel)) return;
+
+	if (wrap) {
+		shift %= count;
+	} else if ((shift >= count) || (shift <= -count)) {
+		// Everything is shifted out
+		fill(layer, firstChannel, count, 0);
+		return;
+	}
+	if (shift == 0) return;
+
+	layer = ring_layer(layer);
+
+#if CUBE_WORKING_BUFFER
+	uint16_t *values = cube_WorkData[layer] + firstChannel;
+	uint16_t old[NUM_TLCS * 16];
+	int moved = count - ((shift > 0) ? shift : -shift);
+
+	memcpy(old, values, count * sizeof(uint16_t));
+
+#if CUBE_CURRENT_LIMIT
+	// Take the span out of the sums here and put it back once it has moved
+	for (int i = 0; i < count; i++) {
+		track_value(layer, firstChannel + i, old[i], 0);
+	}
+#endif
+
+	if (shift > 0) {
+		memcpy(values + shift, old, moved * sizeof(uint16_t));
+		if (wrap) {
+			memcpy(values, old + moved, shift * sizeof(uint16_t));
+		} else {
+			memset(values, 0, shift * sizeof(uint16_t));
 		}
+	} else {
+		memcpy(values, old - shift, moved * sizeof(uint16_t));
+		if (wrap) {
+			memcpy(values + moved, old, -shift * sizeof(uint16_t));
+		} else {
+			memset(values + moved, 0, -shift * sizeof(uint16_t));
+		}
+	}
+#if CUBE_CURRENT_LIMIT
+	for (int i = 0; i < count; i++) {
+		track_value(layer, firstChannel + i, 0, values[i]);
 	}
+#endif
+	cube_dirtyLayers |= 1UL << layer;
+#else
+	// Higher channels are nearer the MSB of the first word
+	shift_bits(cube_GSData[layer], 12 * (NUM_TLCS * 16 - firstChannel - count),
+	           12 * (NUM_TLCS * 16 - firstChannel), 12 * shift, wrap);
+#endif
 }
 
-int LEDCube::getNumTLCs() {
-	return NUM_TLCS;
+/** A permutation of the voxels: axis i of the voxel every voxel comes from is 
+    axis from[i] of the voxel itself, counted from the other end if flip[i] is
+    set. Voxel (x, y, z) is channels (x * CUBE_SIZE + y) * LED_SIZE onwards of 
+    layer z. Every rotation, mirror and transpose of the cube is one of these, so
+    they all share permute_frame(). */
+struct CubePermutation {
+	uint8_t from[3];
+	uint8_t flip[3];
+};
+
+/** Frame permute_frame() reads from, so that it never overwrites a voxel it still
+    needs. Costs CUBE_SIZE * NUM_CHANNELS * 2 bytes of RAM if it is used. */
+static uint16_t cube_scratch[CUBE_SIZE][NUM_TLCS * 16];
+
+/** p followed by q: the voxel p takes each voxel from, moved by q */
+static CubePermutation permutation_then(const CubePermutation &p, const CubePermutation &q)
+{
+	CubePermutation r;
+
+	for (int i = 0; i < 3; i++) {
+		r.from[i] = q.from[p.from[i]];
+		r.flip[i] = p.flip[i] ^ q.flip[p.from[i]];
+	}
+	return r;
 }
 
+/** Moves every voxel of the back buffer as p says. The frame is unpacked into 
+    #cube_scratch 8 channels at a time, every layer is gathered from it and packed
+    back 8 channels at a time. Channels past the last voxel stay as they are. */
+static void permute_frame(const CubePermutation &p)
+{
+	for (int z = 0; z < CUBE_SIZE; z++) {
+#if CUBE_WORKING_BUFFER
+		memcpy(cube_scratch[z], cube_WorkData[ring_layer(z)], sizeof(cube_scratch[0]));
+#else
+		for (int g = 0; g < NUM_TLCS * 2; g++) {
+			unpack8(cube_GSData[ring_layer(z)] + 3 * (NUM_TLCS * 2 - 1 - g), cube_scratch[z] + 8 * g);
+		}
+#endif
+	}
+
+	int c[3];
+	for (c[2] = 0; c[2] < CUBE_SIZE; c[2]++) {
+		int ring = ring_layer(c[2]);
+#if CUBE_WORKING_BUFFER
+		uint16_t *row = cube_WorkData[ring];
+#else
+		uint16_t row[NUM_TLCS * 16];
+		memcpy(row, cube_scratch[c[2]], sizeof(row));
+#endif
+		uint16_t *dst = row;
+
+		for (c[0] = 0; c[0] < CUBE_SIZE; c[0]++) {
+			for (c[1] = 0; c[1] < CUBE_SIZE; c[1]++) {
+				int s[3];
+				for (int i = 0; i < 3; i++) {
+					s[i] = p.flip[i] ? (CUBE_SIZE - 1) - c[p.from[i]] : c[p.from[i]];
+				}
+
+				const uint16_t *src = cube_scratch[s[2]] + (s[0] * CUBE_SIZE + s[1]) * LED_SIZE;
+				for (int k = 0; k < LED_SIZE; k++) {
+					*dst++ = src[k];
+				}
+			}
+		}
 
-/** The logic here is almost identical to the set function which is well documented */
-int LEDCube::get(int layer, int channel) {
+#if CUBE_WORKING_BUFFER
+		cube_dirtyLayers |= 1UL << ring;
+#if CUBE_CURRENT_LIMIT
+		sum_layer(ring);
+#endif
+#else
+		for (int g = 0; g < NUM_TLCS * 2; g++) {
+			pack8(cube_GSData[ring] + 3 * (NUM_TLCS * 2 - 1 - g), row + 8 * g);
+		}
+#endif
+	}
+}
+
+/** Turns the cube by turns quarter turns about axis (CUBE_AXIS_X, CUBE_AXIS_Y or
+    CUBE_AXIS_Z), anticlockwise looking down the axis from its far end: a quarter
+    turn about Z takes the voxel at x = CUBE_SIZE - 1 to y = CUBE_SIZE - 1. 
+    Negative turns go the other way. Draw keeps a spectrum for every voxel that
+    this doesn't move, so with Draw use DrawCube.rotateCube90() instead, or call
+    DrawCube.resyncRGBSpectrum() afterwards. */
+void LEDCube::rotate90(int axis, int turns)
+{
+	// Where voxel (x, y, z) comes from for one quarter turn about each axis
+	// (-n is CUBE_SIZE - 1 - n)
+	static const CubePermutation quarter[3] = {
+		{ { 0, 2, 1 }, { 0, 0, 1 } },	// (x, z, -y)
+		{ { 2, 1, 0 }, { 1, 0, 0 } },	// (-z, y, x)
+		{ { 1, 0, 2 }, { 0, 1, 0 } }	// (y, -x, z)
+	};
+
+	if ((axis < CUBE_AXIS_X) || (axis > CUBE_AXIS_Z)) return;
+
+	turns %= 4;
+	if (turns < 0) turns += 4;
+	if (turns == 0) return;
+
+	CubePermutation p = quarter[axis];
+	for (int i = 1; i < turns; i++) {
+		p = permutation_then(p, quarter[axis]);
+	}
+	permute_frame(p);
+}
+
+/** Mirrors the cube along axis (CUBE_AXIS_X, CUBE_AXIS_Y or CUBE_AXIS_Z). Along Z 
+    only whole layers move, so the packed layers are swapped a word at a time, 
+    channels past the last voxel and all, as rotateLayers() does. With Draw use
+    DrawCube.mirrorCube(), which moves the spectrum too (see rotate90()). */
+void LEDCube::mirror(int axis)
+{
+	if ((axis < CUBE_AXIS_X) || (axis > CUBE_AXIS_Z)) return;
+
+	if (axis == CUBE_AXIS_Z) {
+		for (int z = 0; z < CUBE_SIZE / 2; z++) {
+			int a = ring_layer(z), b = ring_layer(CUBE_SIZE - 1 - z);
+#if CUBE_WORKING_BUFFER
+			uint16_t tmp[NUM_TLCS * 16];
+			memcpy(tmp, cube_WorkData[a], sizeof(tmp));
+			memcpy(cube_WorkData[a], cube_WorkData[b], sizeof(tmp));
+			memcpy(cube_WorkData[b], tmp, sizeof(tmp));
+			cube_dirtyLayers |= (1UL << a) | (1UL << b);
+#if CUBE_CURRENT_LIMIT
+			sum_layer(a);
+			sum_layer(b);
+#endif
+#else
+			unsigned int tmp[NUM_TLCS * 6];
+			memcpy(tmp, cube_GSData[a], sizeof(tmp));
+			memcpy(cube_GSData[a], cube_GSData[b], sizeof(tmp));
+			memcpy(cube_GSData[b], tmp, sizeof(tmp));
+#endif
+		}
+		return;
+	}
+
+	CubePermutation p = { { 0, 1, 2 }, { 0, 0, 0 } };
+	p.flip[axis] = 1;
+	permute_frame(p);
+}
+
+/** Swaps X and Y, mirroring every layer about its x = y diagonal. With Draw use
+    DrawCube.transposeCube(), which moves the spectrum too (see rotate90()). */
+void LEDCube::transpose(void)
+{
+	static const CubePermutation swapXY = { { 1, 0, 2 }, { 0, 0, 0 } };
+
+	permute_frame(swapXY);
+}
+
+/** Sets count channels, starting at firstChannel, to value. The value is packed
+    once and stored a word at a time instead of going through set() for every
+    channel. Like set(), nothing happens if value isn't 0-4095. */
+void LEDCube::fill(int layer, int firstChannel, int count, int value)
+{
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
+	if ((value < 0) || (value > 4095)) return;
 
-	unsigned int index32 = (NUM_TLCS * 16 - 1) - channel;
-	unsigned int *index12p = cube_GSData[layer] + ((index32 * 3) >> 3);
-	int caseNum = index32 % 8;
-	int value = 0x000;
-
-	switch(caseNum){
-		case 0:
-			value |= ((*index12p >> 20) & 0xFFF);
-			break;
-		case 1:
-			value |= ((*index12p >> 8) & 0xFFF);
-			break;
-		case 2:
-			value |= ((*index12p << 4) & 0xFF0);
-			index12p++;
-			value |= ((*index12p >> 28) & 0xF);
-			break;
-		case 3:
-			value |= ((*index12p >> 16) & 0xFFF);
-			break;
-		case 4:
-			value |= ((*index12p >> 4) & 0xFFF);
-			break;
-		case 5:
-			value |= ((*index12p << 8) & 0xF00);
-			index12p++;
-			value |= ((*index12p >> 24) & 0xFF);
-			break;
-		case 6:
-			value |= ((*index12p >> 12) & 0xFFF);
-			break;
-		case 7:
-			value |= (*index12p & 0xFFF);
-			break;
-	}
-	return value;
+	fill_layers(layer, layer, firstChannel, count, &value, 1);
 }
 
 
 
 // RGB Helper functions
 #if RGB_LEDS
-void LEDCube::loadColorData() {
-	
-	
+void LEDCube::setAllRGB(int red, int green, int blue){
+	int colors[3] = { blue, green, red };
+
+	fill_layers(0, CUBE_SIZE - 1, 0, RGB_CHANNELS * 3, colors, 3);
 }
 
-void LEDCube::setAllRGB(int red, int green, int blue){
-	for(int _layer = 0; _layer < CUBE_SIZE; _layer++) {
-		for (int _channel = 0; _channel < RGB_CHANNELS; _channel++){
-		       setRGB(_layer, _channel, red, green, blue);
-		}
+void LEDCube::setAllRGBOnLayer(int layer, int red, int green, int blue){
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
+
+	int colors[3] = { blue, green, red };
+
+	fill_layers(layer, layer, 0, RGB_CHANNELS * 3, colors, 3);
+}
+
+// Sets count RGB LEDs, starting at RGB channel firstChannel, to one colour (see fill()).
+// Any colour that isn't 0-4095 is left alone, as with setRGB().
+void LEDCube::fillRGB(int layer, int firstChannel, int count, int r, int g, int b){
+	if ((layer < 0) || (layer >= CUBE_SIZE)) return;
+
+	// Keep the span on whole LEDs
+	if (firstChannel < 0) {
+		count += firstChannel;
+		firstChannel = 0;
+	}
+	if (count > RGB_CHANNELS - firstChannel) {
+		count = RGB_CHANNELS - firstChannel;
 	}
+
+	int colors[3] = { b, g, r };
+
+	fill_layers(layer, layer, firstChannel * 3, count * 3, colors, 3);
 }
 
-void LEDCube::setAllRGBOnLayer(int layer, int red, int green, int blue){
-		for (int _channel = 0; _channel < RGB_CHANNELS; _channel++){
-		       setRGB(layer, _channel, red, green, blue);
-		}
+// Sets rows runs of count RGB LEDs on layers firstLayer to lastLayer to one colour,
+// run r starting at RGB channel firstChannel + r * rowStride. With the Draw 
+// coordinates a box is one run per x, along y. Every run is written into the packed
+// words a word at a time (see fill_rows()). Colours that aren't 0-4095 are left alone.
+void LEDCube::fillRGBRows(int firstLayer, int lastLayer, int firstChannel, int count, int rows, int rowStride, int r, int g, int b){
+	if (firstLayer < 0) firstLayer = 0;
+	if (lastLayer > CUBE_SIZE - 1) lastLayer = CUBE_SIZE - 1;
+	if ((firstLayer > lastLayer) || (count <= 0)) return;
+
+	int colors[3] = { b, g, r };
+
+	fill_rows(firstLayer, lastLayer, firstChannel * 3, count * 3, rows, rowStride * 3, colors, 3);
 }
 
 // RGB LEDs are connected to the TLC sequentially
@@ -610,6 +1748,40 @@ void LEDCube::setRGB(int layer, int channel, int r, int g, int b){
 	set(layer, tlc_channel, r);
 }
 
+// setRGB() without any of its checks, for the Draw primitives that have already
+// clipped their voxels to the cube and checked the colour once. layer, channel
+// and all three colours must be in range.
+void LEDCube::setRGBUnchecked(int layer, int channel, int r, int g, int b){
+	int tlc_channel = channel * 3;
+
+	layer = ring_layer(layer);
+
+#if CUBE_WORKING_BUFFER
+	uint16_t *values = cube_WorkData[layer] + tlc_channel;
+
+	track_value(layer, tlc_channel, values[0], b);
+	track_value(layer, tlc_channel + 1, values[1], g);
+	track_value(layer, tlc_channel + 2, values[2], r);
+	values[0] = b;
+	values[1] = g;
+	values[2] = r;
+	cube_dirtyLayers |= 1UL << layer;
+#else
+	// The 36 bits of the LED are r, g, b from the MSB side. Channels start on 
+	// 4 bit boundaries, so they start at most 28 bits into a word and always end
+	// in the next one: both words are written in one go.
+	int bit = 12 * (NUM_TLCS * 16 - 3 - tlc_channel);
+	unsigned int *w = cube_GSData[layer] + (bit >> 5);
+	int shift = 28 - (bit & 31);
+
+	uint64_t value = ((uint64_t)r << 24 | (unsigned int)g << 12 | (unsigned int)b) << shift;
+	uint64_t mask = 0xFFFFFFFFFull << shift;
+
+	w[0] = (w[0] & ~(unsigned int)(mask >> 32)) | (unsigned int)(value >> 32);
+	w[1] = (w[1] & ~(unsigned int)mask) | (unsigned int)value;
+#endif
+}
+
 // Each RGB LED is connected to multiple TLCs.
 // i.e. ch 0 = R1, ch 1 = R2, ch 16 = G1, ch 17 = G2, ch 32 = B1, ch 33 = B2
 void LEDCube::setRGB2(int layer, int channel, int r, int g, int b){
@@ -646,33 +1818,28 @@ int LEDCube::getBlue(int layer, int channel) {
 #if VPRG_ENABLED
 
 void LEDCube::setDC(int channel, int value){
+	if (channel < 0 || channel >= NUM_TLCS * 16 || value < 0 || value > 63) {
+		return;
+	}
 
-	uint8_t index8 = (NUM_TLCS * 16 -1) - channel;
-	uint8_t *index6p = tlc_DCData + ((index8 * 3) >> 2);	// index * 3 / 4 = which array element the bits start it
-	int caseNum = index8 % 4; 
-
-	switch(caseNum){
-		case 0:
-			*index6p = (*index6p & 0x03) | value << 2;
-			break;
-		case 1:
-			*index6p = (*index6p & 0xFC) | value >> 4;
-			index6p++;
-			*index6p = (*index6p & 0x0F) | value << 4;
-			break;
-		case 2:
-			*index6p = (*index6p & 0xF0) | value >> 2;
-			index6p++;
-			*index6p = (*index6p & 0x3F) | value << 6;
-			break;
-		case 3:
-			*index6p = (*index6p & 0xC0) | value;
-			break;
+	// Bit offset of the channel, counted from the MSB of the first word
+	unsigned int offset = ((NUM_TLCS * 16 - 1) - channel) * 6;
+	unsigned int *index32p = tlc_DCData + (offset >> 5);
+	int shift = offset & 31;
+
+	if (shift <= 26) {
+		// All 6 bits are in this word
+		*index32p = (*index32p & ~(0x3Fu << (26 - shift))) | (unsigned int)value << (26 - shift);
+	} else {
+		// The upper bits end this word and the lower bits start the next one
+		*index32p = (*index32p & ~(0x3Fu >> (shift - 26))) | (unsigned int)value >> (shift - 26);
+		index32p++;
+		*index32p = (*index32p & ~(0x3Fu << (58 - shift))) | (unsigned int)value << (58 - shift);
 	}
 }
 
 void LEDCube::setAllDC(int value){
-	for (int i=0; i<NUM_TLCS; i++){
+	for (int i=0; i<NUM_TLCS * 16; i++){
 		setDC(i, value);
 	}
 }
@@ -680,64 +1847,61 @@ void LEDCube::setAllDC(int value){
 
 int LEDCube::getDC(int channel){
 
-	uint8_t index8 = (NUM_TLCS * 16 -1) - channel;
-	uint8_t *index6p = tlc_DCData + ((index8 * 3) >> 2);	// index * 3 / 4 = which array element the bits start it
-	int caseNum = index8 % 4; 
-	int value = 0;
-
-	switch (caseNum){
-		case 0:
-			value |= (*index6p >> 2) & 0x3F;
-			break;
-		case 1:
-			value |= (*index6p << 4) & 0x30;
-			index6p++;
-			value |= (*index6p >> 4) & 0x0F;
-			break;
-		case 2:
-			value |= (*index6p << 2) & 0x3C;
-			index6p++;
-			value |= (*index6p >> 6) & 0x03;
-			break;
-		case 3:
-			value |= (*index6p & 0x3F);
-			break;
-	}
-	return value;
-}
-
-/** Send the bits for Dot Correction to the TLC*/
+	unsigned int offset = ((NUM_TLCS * 16 - 1) - channel) * 6;
+	unsigned int *index32p = tlc_DCData + (offset >> 5);
+	int shift = offset & 31;
+
+	if (shift <= 26) {
+		return (*index32p >> (26 - shift)) & 0x3F;
+	}
+	return ((index32p[0] << (shift - 26)) | (index32p[1] >> (58 - shift))) & 0x3F;
+}
+
+/** Send the bits for Dot Correction to the TLC. Uses the same path as the
+    grayscale data, so with TLC_SPI_DMA it returns straight away; the XLAT
+    interrupt drops VPRG again once the TLCs have latched it. While the refresh
+    engine runs it only asks the engine to send it in place of the next layer,
+    which holds the layer that is lit on for one more layer period, and returns 0;
+    updateInProgress() tells you when the DC has been latched. */
 int LEDCube::updateDC(){
 
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	if (cube_refreshState == REFRESH_RUNNING) {
+		cube_needDC = DC_QUEUED;
+		return 0;
+	}
+#endif
+
 	// if needXLAT, there is already an update in process
-	if (cube_needXLAT){
+	if (cube_needXLAT || cube_refreshState){
 		return 1;
 	}
 
-
 	// Set VPRG High to switch to DC programming mode
 	setHigh(VPRG_PORT, VPRG);
 
-	// SPI didn't work out so well since I'm using an array of uint8_t
-	// So let's try bit banging
-	for(int i = 0; i < (NUM_TLCS * 12); i++) {
-		for(int s = 7; s >= 0; s--)
-		{
-			if(tlc_DCData[i] >> s & 0x1) {
-				setHigh(SOUT_PORT, SOUT);
-			} else {
-				setLow(SOUT_PORT, SOUT);
-			}
+#if DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+	parallel_send(tlc_DCData, NUM_TLCS * 3);
+	request_xlat_pulse();
+
+#elif DATA_TRANSFER_MODE == TLC_SPI
+	// 96 bits per TLC, 3 words
+	spi_send(tlc_DCData, NUM_TLCS * 3);
+	spi_wait();
 
-			pulse_pin(SCLK_PORT, SCLK);
-		}
-	}
 	request_xlat_pulse();
 
+#elif DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// The DMA interrupt requests the XLAT pulse, just like it does for update()
+	cube_needXLAT = 1;
+
+	dma_send(tlc_DCData, NUM_TLCS * 3);
+#endif
+
 	return 0;
 }
 
-uint8_t* LEDCube::getDCData(){
+unsigned int* LEDCube::getDCData(){
 	return tlc_DCData;
 }
 #endif
@@ -758,8 +1922,8 @@ but at least this way we have an entire cycle to setup the XLAT pulse. If we dec
 setup XLAT immediately, we would run the risk of setting XLAT right in the middle of when
 it was supposed to be checked and we could run into some nasty race conditions. 
 **/
-void LEDCube::request_xlat_pulse(){
-
+static void xlat_on_next_blank(void)
+{
 	// Set this flag so that we can keep track of whether or not we are waiting for an XLAT pulse
 	cube_needXLAT = 1;
 
@@ -767,6 +1931,24 @@ void LEDCube::request_xlat_pulse(){
 	ConfigIntOC5(OC_INT_ON | OC_INT_PRIOR_3 | OC_INT_SUB_PRI_3);
 }
 
+void LEDCube::request_xlat_pulse(){
+	xlat_on_next_blank();
+}
+
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+// Called by the DMA interrupt of each SPI module once it has handed over its last word
+static void chain_sent(void)
+{
+	// Wait for the other half of the chain
+	if (--cube_shifting) return;
+
+	// The refresh engine's BLANK interrupt is already on and asks for XLAT itself
+	if (!cube_refreshState) {
+		xlat_on_next_blank();
+	}
+}
+#endif
+
 #ifdef __cplusplus
 extern "C"	// So c++ doesn't mangle the function names
 {
@@ -775,6 +1957,18 @@ extern "C"	// So c++ doesn't mangle the function names
 	// Handle the interrupt triggered by BLANK
 	void __ISR(_OUTPUT_COMPARE_5_VECTOR, ipl3) IntOC5Handler(void)	
 	{
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+		// The refresh engine leaves this interrupt on and only asks for XLAT once the
+		// current layer has been up for long enough and the next one has been sent
+		if (cube_refreshState) {
+			cube_heldCycles++;
+			if ((cube_heldCycles >= CUBE_LAYER_CYCLES) && !cube_shifting) {
+				SetPulseOC4(0x1, 0x2);
+			}
+			return;
+		}
+#endif
+
 		// Stop BLANK from firing any more interrupts
 		ConfigIntOC5(OC_INT_OFF);
 
@@ -793,12 +1987,70 @@ extern "C"	// So c++ doesn't mangle the function names
 
 		mOC4ClearIntFlag();
 
-		// If VPRG is High, then we just programmed DC
-		// if (outputState(VPRG_PORT, VPRG)){
-		// 	setLow(VPRG_PORT, VPRG);
-		// 	pulse_pin(SCLK_PORT, SCLK);
-		// }
+		// If VPRG is High, then we just programmed DC. The TLCs swallow the first SCLK
+		// after a DC latch, so give them that one now, before anything else is sent. 
+		// SPI2 owns the SCLK pin in the SPI modes, so there it is a dummy word: its bits
+		// go into the GS shift register and are pushed out the end by the next update.
+		int dcLatched = outputState(VPRG_PORT, VPRG);
+		if (dcLatched){
+			setLow(VPRG_PORT, VPRG);
+#if VPRG_ENABLED && DATA_TRANSFER_MODE == TLC_SPI_DMA
+			// Unless updateDC() has asked for it again since it was sent
+			if (cube_needDC == DC_SENT) cube_needDC = 0;
+#endif
+#if DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL
+			pulse_pin(SCLK_PORT, SCLK);
+#else
+			putcSPI2(0);
+	#if CUBE_SPI_CHAINS == 2
+			putcSPI1(0);
+	#endif
+#endif
+		}
 
+#if CUBE_DOUBLE_BUFFER
+		// currentLayer is the layer just latched; it only moves on after this, here
+		// for the refresh engine and in stepLayer() for a manual scan. After the last
+		// layer of a frame is the one place a swap can't tear it.
+		if (!dcLatched) {
+			if (cube_needSwap && (currentLayer == CUBE_SIZE - 1)) swap_buffers();
+			cube_midFrame = (currentLayer != CUBE_SIZE - 1);
+		}
+#endif
+
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+		// Light the layer that was just latched and start sending the next one. 
+		// The swap above has already happened, so a new frame starts from layer 0.
+		// A DC latch leaves the grayscale data, so the lit layer just stays on.
+		if (cube_refreshState) {
+			if (!dcLatched) show_current_layer();
+			cube_heldCycles = 0;
+
+			if (cube_refreshState == REFRESH_RUNNING) {
+	#if VPRG_ENABLED
+				if (cube_needDC == DC_QUEUED) {
+					cube_needDC = DC_SENT;
+					setHigh(VPRG_PORT, VPRG);
+					cube_needXLAT = 1;
+					dma_send(tlc_DCData, NUM_TLCS * 3);
+				} else
+	#endif
+				send_layer(currentLayer);
+			} else {
+				ConfigIntOC5(OC_INT_OFF);
+				cube_refreshState = REFRESH_OFF;
+	#if VPRG_ENABLED
+				// A DC still queued goes out as a manual update
+				if (cube_needDC == DC_QUEUED) {
+					cube_needDC = DC_SENT;
+					setHigh(VPRG_PORT, VPRG);
+					cube_needXLAT = 1;
+					dma_send(tlc_DCData, NUM_TLCS * 3);
+				}
+	#endif
+			}
+		}
+#endif
 
 		if (tlc_onUpdateFinished) {
 		    tlc_onUpdateFinished();
@@ -806,6 +2058,31 @@ extern "C"	// So c++ doesn't mangle the function names
 		//OpenTimer2(T2_ON | T2_PS_1_4, 0x3);
 	}
 
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// Handle the interrupt triggered when the DMA has handed the last word to SPI2.
+	// The last word is still shifting out, but it only takes 32 SCLKs and the XLAT 
+	// pulse is at least one whole BLANK cycle away.
+	void __ISR(_DMA_0_VECTOR, ipl3) IntDMA0Handler(void)
+	{
+		DmaChnClrEvFlags(GS_DMA_CHN, DMA_EV_ALL_EVNTS);
+		DmaChnClrIntFlag(GS_DMA_CHN);
+
+		chain_sent();
+	}
+
+	#if CUBE_SPI_CHAINS == 2
+	// Same for the half of the chain on SPI1. Both handlers are at ipl3, so they 
+	// never interrupt each other while counting cube_shifting down.
+	void __ISR(_DMA_1_VECTOR, ipl3) IntDMA1Handler(void)
+	{
+		DmaChnClrEvFlags(CHAIN1_DMA_CHN, DMA_EV_ALL_EVNTS);
+		DmaChnClrIntFlag(CHAIN1_DMA_CHN);
+
+		chain_sent();
+	}
+	#endif
+#endif
+
 #ifdef __cplusplus
 }
 #endif
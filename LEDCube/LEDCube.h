@@ -27,12 +27,23 @@ http://playground.arduino.cc/learning/TLC5940
 
 //extern unsigned int tlc_GSData[NUM_TLCS * 6];
 
+// Values returned by updateStatus()
+#define CUBE_UPDATE_IDLE		0	// Nothing in flight, safe to start the next layer
+#define CUBE_UPDATE_SHIFTING	1	// Layer data is still going out over SPI
+#define CUBE_UPDATE_LATCHING	2	// Layer data is shifted in, waiting for the XLAT pulse
+
+// Axes for rotate90() and mirror(). Voxel (x, y, z) is LED x * CUBE_SIZE + y of layer z.
+#define CUBE_AXIS_X		0
+#define CUBE_AXIS_Y		1
+#define CUBE_AXIS_Z		2
+
 class LEDCube
 {
   public:
 	void init(int initialValue = 0);
 	void clearAll(void);
 	int clearLayer(int layer);
+	void rotateLayers(int count);
 	int update(void);
 	int startUpdate(void);
 	void finishUpdate(void);
@@ -43,12 +54,45 @@ class LEDCube
 	void setAll(int value);
 	int getNumTLCs();
 	int get(int layer, int channel);
+	void setRange(int layer, int firstChannel, const uint16_t *values, int count);
+	void getRange(int layer, int firstChannel, uint16_t *values, int count);
+	void fill(int layer, int firstChannel, int count, int value);
+	void shiftChannels(int layer, int firstChannel, int count, int shift, int wrap);
+	void rotate90(int axis, int turns);
+	void mirror(int axis);
+	void transpose(void);
 	int updateInProgress(void);
+	int updateStatus(void);
+	void present(void);
+	int presentPending(void);
+
+#if CUBE_WORKING_BUFFER
+	uint16_t* getWorkData(int layer);
+	void setLayerDirty(int layer);
+#endif
+
+#if CUBE_GAMMA_ENABLED
+	void setBrightness(int brightness);
+#endif
+
+#if CUBE_CURRENT_LIMIT
+	int getLayerCurrent(int layer);
+	int getTLCCurrent(int layer, int tlc);
+#endif
+
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	void startRefresh(void);
+	void stopRefresh(void);
+	int refreshRunning(void);
+#endif
 
 #if RGB_LEDS
 	void setAllRGB(int red, int green, int blue);
 	void setAllRGBOnLayer(int layer, int red, int green, int blue);
+	void fillRGB(int layer, int firstChannel, int count, int r, int g, int b);
+	void fillRGBRows(int firstLayer, int lastLayer, int firstChannel, int count, int rows, int rowStride, int r, int g, int b);
 	void setRGB(int layer, int channel, int r, int g, int b);
+	void setRGBUnchecked(int layer, int channel, int r, int g, int b);
 	void setRGB2(int layer, int channel, int r, int g, int b);
 	int getRed(int layer, int channel);
 	int getGreen(int layer, int channel);
@@ -60,7 +104,7 @@ class LEDCube
 	void setDC(int channel, int value);
 	int getDC(int channel);
 	int updateDC();
-	uint8_t* getDCData();
+	unsigned int* getDCData();
     //void setAllDC(uint8_t r, uint8_t g, uint8_t b);
     //void setAllDCtest(uint8_t r, uint8_t g, uint8_t b);
 #endif
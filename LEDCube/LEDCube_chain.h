@@ -0,0 +1,19 @@
+/** LEDCubeChain<NumTLCs, Wiring>: where every channel of one layer of the cube
+    goes in its packed grayscale data. The Cube variable packs each of its
+    layers with LEDCubeChain<NUM_TLCS>::pack().
+
+    This is the Tlc5940Chain template of the Tlc5940 library (see 
+    Tlc5940/Tlc5940Chain.h for the layout), so both libraries share one set of
+    compile-time channel tables. The Tlc5940 folder has to sit next to this one,
+    as it does in this repository; only that header is used, none of the 
+    Tlc5940 library's code. Needs a C++11 compiler (-std=gnu++11). */
+
+#ifndef LEDCUBE_CHAIN_H
+#define LEDCUBE_CHAIN_H
+
+#include "../Tlc5940/Tlc5940Chain.h"
+
+template<int NumTLCs, typename Wiring = TlcStraightWiring>
+using LEDCubeChain = Tlc5940Chain<NumTLCs, Wiring>;
+
+#endif
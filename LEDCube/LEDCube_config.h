@@ -95,14 +95,14 @@ http://playground.arduino.cc/learning/TLC5940
 #if RGB_LEDS
 
     // Number of colors in each LED
-    #ifndef
+    #ifndef LED_SIZE
 	   #define LED_SIZE   3
     #endif
 
 	// Ensures only a combination of max two colors are on at once. 
 	// If all three colors are told to be set at once it will adjust. 
     // This ensures you get all the necessary colors while limiting current
-    #ifndef
+    #ifndef LIMIT_CURRENT
 	   #define LIMIT_CURRENT    1 
     #endif
 
@@ -122,16 +122,148 @@ http://playground.arduino.cc/learning/TLC5940
 // Use the much faster hardware SPI module
 #define TLC_SPI            1
 
+// Hardware SPI fed by a DMA channel, so startUpdate() doesn't block
+#define TLC_SPI_DMA        2
+
+// Bit-bang several chains at once, one PORTB bit of SIN each and a shared SCLK
+#define TLC_PARALLEL       3
+
 #ifndef TLC_SPI_PRESCALER_FLAGS
 	#define TLC_SPI_PRESCALER_FLAGS PRI_PRESCAL_4_1|SEC_PRESCAL_4_1
 #endif
 
 /** Determines how data should be transfered to the TLCs.  Bit-banging can use
     any two i/o pins, but the hardware SPI is faster.
-    - Bit-Bang = TLC_BITBANG --> *NOT YET WORKING* 
-    - Hardware SPI = TLC_SPI (default) */
+    - Bit-Bang = TLC_BITBANG
+    - Hardware SPI = TLC_SPI
+    - Hardware SPI with DMA = TLC_SPI_DMA (default)
+    - Parallel chains on PORTB = TLC_PARALLEL (see CUBE_PARALLEL_CHAINS) */
 #ifndef DATA_TRANSFER_MODE
-	#define DATA_TRANSFER_MODE TLC_SPI
+	#define DATA_TRANSFER_MODE TLC_SPI_DMA
+#endif
+
+// Number of SPI modules the chain is split over. With 2 the TLCs are wired as two
+// chains that share XLAT, BLANK, GSCLK and VPRG: TLCs 0 to NUM_TLCS / 2 - 1 stay on
+// SPI2 (pins 11/13) and the rest hang off SPI1 (SDO1/SCK1), with its own DMA channel
+// in TLC_SPI_DMA mode. Both halves of a layer are shifted out at the same time, so
+// sending a layer takes half as long. Needs TLC_SPI or TLC_SPI_DMA and an even NUM_TLCS.
+#ifndef CUBE_SPI_CHAINS
+	#define CUBE_SPI_CHAINS  1
+#endif
+
+#if (CUBE_SPI_CHAINS != 1) && (CUBE_SPI_CHAINS != 2)
+	#error "CUBE_SPI_CHAINS must be 1 or 2"
+#endif
+
+#if (CUBE_SPI_CHAINS == 2) && (DATA_TRANSFER_MODE == TLC_BITBANG || DATA_TRANSFER_MODE == TLC_PARALLEL)
+	#error "CUBE_SPI_CHAINS 2 needs DATA_TRANSFER_MODE TLC_SPI or TLC_SPI_DMA"
+#endif
+
+#if (CUBE_SPI_CHAINS == 2) && (NUM_TLCS % 2)
+	#error "CUBE_SPI_CHAINS 2 splits the chain in half, NUM_TLCS must be even"
+#endif
+
+// Number of chains for DATA_TRANSFER_MODE TLC_PARALLEL. The TLCs are split into this
+// many chains of NUM_TLCS / CUBE_PARALLEL_CHAINS, chain 0 holding the first TLCs, and 
+// the SIN of chain n goes on RBn. They all share SCLK (pin 13), XLAT, BLANK, GSCLK and
+// VPRG. Every SCLK edge shifts a bit into each chain, so a layer goes out in 
+// 1 / CUBE_PARALLEL_CHAINS of the time a single chain would take. Up to 16, and it
+// must divide NUM_TLCS: 6 chains of 2 TLCs for the default 12.
+#ifndef CUBE_PARALLEL_CHAINS
+	#define CUBE_PARALLEL_CHAINS  6
+#endif
+
+#if DATA_TRANSFER_MODE == TLC_PARALLEL
+	#if (CUBE_PARALLEL_CHAINS < 1) || (CUBE_PARALLEL_CHAINS > 16)
+		#error "CUBE_PARALLEL_CHAINS must be 1 to 16"
+	#endif
+
+	#if NUM_TLCS % CUBE_PARALLEL_CHAINS
+		#error "NUM_TLCS must be a multiple of CUBE_PARALLEL_CHAINS"
+	#endif
+#endif
+
+// Draw into a back buffer and only show it once present() is called. The buffers are
+// swapped at the XLAT of the last layer, by the refresh engine or a manual scan, so
+// a frame never mixes old and new data, or at once if the scan is between two 
+// frames with nothing being sent. Costs a second copy of the grayscale data in RAM.
+#ifndef CUBE_DOUBLE_BUFFER
+	#define CUBE_DOUBLE_BUFFER  0
+#endif
+
+// Keep a plain 16-bit value per channel per layer for set()/get() and the fills to
+// work on, and only pack the layers that changed into the SPI buffer when present()
+// is called. Effects that read back a lot of channels get much cheaper. Nothing
+// shows on the cube until present(). Costs CUBE_SIZE * NUM_CHANNELS * 2 bytes of RAM.
+#ifndef CUBE_WORKING_BUFFER
+	#define CUBE_WORKING_BUFFER  0
+#endif
+
+#if CUBE_WORKING_BUFFER && (CUBE_SIZE > 32)
+	#error "CUBE_WORKING_BUFFER tracks changed layers in 32 bits, CUBE_SIZE can't be over 32"
+#endif
+
+// Map every value through a gamma curve and a brightness setting (setBrightness())
+// when present() packs it, so that fades look even to the eye. get() still returns
+// the value that was set. The 4096 entry table is built by the compiler (see
+// LEDCube_gamma.h, needs C++11) and takes 8KB of flash. Needs CUBE_WORKING_BUFFER.
+#ifndef CUBE_GAMMA_ENABLED
+	#define CUBE_GAMMA_ENABLED  0
+#endif
+
+// Exponent of the gamma curve. 1.0 gives a straight line (brightness only).
+#ifndef CUBE_GAMMA
+	#define CUBE_GAMMA  2.2
+#endif
+
+#if CUBE_GAMMA_ENABLED && !CUBE_WORKING_BUFFER
+	#error "CUBE_GAMMA_ENABLED needs CUBE_WORKING_BUFFER, so that get() and the Draw effects see the values that were set"
+#endif
+
+// Current budget of a lit layer, in mA, so a full white layer can't brown out the
+// supply. The grayscale of every layer (and of every TLC on it) is summed as the
+// channels are set, and present() scales down any layer that would go over when it
+// packs it. 0 turns it off. Needs CUBE_WORKING_BUFFER.
+#ifndef CUBE_LAYER_BUDGET_MA
+	#define CUBE_LAYER_BUDGET_MA  0
+#endif
+
+// Same for the 16 channels of one TLC, to keep its power dissipation down. 0 is no limit.
+#ifndef CUBE_TLC_BUDGET_MA
+	#define CUBE_TLC_BUDGET_MA  0
+#endif
+
+// Current through a channel at 4095, set by the resistor on IREF: 39.06 / R (~20mA for 2K)
+#ifndef CUBE_CHANNEL_MA
+	#define CUBE_CHANNEL_MA  20
+#endif
+
+#define CUBE_CURRENT_LIMIT  (CUBE_LAYER_BUDGET_MA || CUBE_TLC_BUDGET_MA)
+
+#if CUBE_CURRENT_LIMIT && !CUBE_WORKING_BUFFER
+	#error "CUBE_LAYER_BUDGET_MA and CUBE_TLC_BUDGET_MA need CUBE_WORKING_BUFFER, the layers are scaled as present() packs them"
+#endif
+
+// Let the XLAT interrupt scan the layers on its own, so loop() never has to call
+// startUpdate()/finishUpdate(). init() starts it; see startRefresh()/stopRefresh().
+// Needs DATA_TRANSFER_MODE TLC_SPI_DMA.
+#ifndef CUBE_AUTO_REFRESH
+	#define CUBE_AUTO_REFRESH  0
+#endif
+
+// Number of GS cycles (BLANK periods, ~820us each) every layer stays lit while the
+// refresh engine runs. 2 is the minimum, as the next layer is sent during the first one.
+// Refresh rate = 80MHz / 16 / 4100 / (CUBE_SIZE * CUBE_LAYER_CYCLES), ~76Hz for 8 layers
+#ifndef CUBE_LAYER_CYCLES
+	#define CUBE_LAYER_CYCLES  2
+#endif
+
+#if CUBE_AUTO_REFRESH && (DATA_TRANSFER_MODE != TLC_SPI_DMA)
+	#error "CUBE_AUTO_REFRESH needs DATA_TRANSFER_MODE TLC_SPI_DMA"
+#endif
+
+#if CUBE_LAYER_CYCLES < 2
+	#error "CUBE_LAYER_CYCLES must be at least 2"
 #endif
 
 // Defines whether or not you will be able to set Dot Correction
@@ -0,0 +1,17 @@
+/** Gamma table for CUBE_GAMMA_ENABLED (see LEDCube_config.h).
+
+    cube_gammaTable[v] = round(4095 * (v / 4095) ^ CUBE_GAMMA) for v = 0 to 4095.
+    The table is generated by the compiler by the Tlc5940 library's tlc_gamma.h,
+    so the two libraries share one generator; the Tlc5940 folder has to sit next
+    to this one, as it does in this repository. Only that header is used, none
+    of the Tlc5940 library's code. Needs a C++11 compiler (-std=gnu++11). */
+
+#ifndef LEDCUBE_GAMMA_H
+#define LEDCUBE_GAMMA_H
+
+#include <LEDCube_config.h>
+#include "../Tlc5940/tlc_gamma.h"
+
+#define cube_gammaTable	TLC_GAMMA_TABLE(CUBE_GAMMA)
+
+#endif
@@ -1,6 +1,14 @@
 #include <tlc_config.h>
 #include "Tlc5940.h"
+#include "Tlc5940Chain.h"
 #include <plib.h>
+#include <string.h>
+
+#if TLC_GAMMA_ENABLED
+#include "tlc_gamma.h"
+
+#define tlc_gammaTable	TLC_GAMMA_TABLE(TLC_GAMMA)
+#endif
 
 
 
@@ -10,15 +18,42 @@
 #define setHigh(port, pin)		port |= pin;
 #define outputState(port, pin)	port & pin
 
+/** Body of the busy-wait loops. Nothing to do on the chipKIT; the host
+    simulator (HostSim/plib.h) defines it to let simulated time pass. */
+#ifndef busy_wait
+	#define busy_wait()
+#endif
+
 /** Chipkit Ports **/
 #define VPRG 0x2
 #define VPRG_PORT PORTF
 
-#define SOUT 0x100
-#define SOUT_PORT PORTG
+/** Builds a register name, e.g. TLC_REG(PORT, G, SET) is PORTGSET */
+#define TLC_REG_(reg, port, op)	reg##port##op
+#define TLC_REG(reg, port, op)	TLC_REG_(reg, port, op)
 
+/** SIN and SCLK: the SPI2 pins, or any two pins when bit-banging */
+#if DATA_TRANSFER_MODE == TLC_BITBANG
+#define SOUT TLC_BITBANG_SIN
+#define SOUT_LETTER TLC_BITBANG_SIN_PORT
+#define SCLK TLC_BITBANG_SCLK
+#define SCLK_LETTER TLC_BITBANG_SCLK_PORT
+#else
+#define SOUT 0x100
+#define SOUT_LETTER G
 #define SCLK 0x40
-#define SCLK_PORT PORTG
+#define SCLK_LETTER G
+#endif
+
+#define SOUT_PORT TLC_REG(PORT, SOUT_LETTER, )
+#define SOUT_PORTSET TLC_REG(PORT, SOUT_LETTER, SET)
+#define SOUT_PORTCLR TLC_REG(PORT, SOUT_LETTER, CLR)
+#define SOUT_TRISCLR TLC_REG(TRIS, SOUT_LETTER, CLR)
+
+#define SCLK_PORT TLC_REG(PORT, SCLK_LETTER, )
+#define SCLK_PORTSET TLC_REG(PORT, SCLK_LETTER, SET)
+#define SCLK_PORTCLR TLC_REG(PORT, SCLK_LETTER, CLR)
+#define SCLK_TRISCLR TLC_REG(TRIS, SCLK_LETTER, CLR)
 
 #define GSCLK 0x1
 #define GSCLK_PORT PORTD
@@ -29,6 +64,10 @@
 #define XLAT 0x8
 #define XLAT_PORT PORTD
 
+/** DMA channel that feeds SPI2 in TLC_SPI_DMA mode. The handler below is
+    tied to _DMA_0_VECTOR, so change both together. */
+#define GS_DMA_CHN DMA_CHANNEL0
+
 /** Packed grayscale data, 24 bytes (16 * 12 bits) per TLC.
 
     Format: Lets assume we have 2 TLCs, A and B, daisy-chained with the SOUT of
@@ -42,22 +81,44 @@
     - ...
     - byte 47: lower 8 bits of A.0
 
+    The buffer belongs to #tlc_chain, which does the packing (Tlc5940Chain.h).
+
     \note Normally packing data like this is bad practice.  But in this
           situation, shifting the data out is really fast because the format of
           the array is the same as the format of the TLC's serial interface. */
-unsigned int tlc_GSData[NUM_TLCS * 6]; // 6 * 32 = 192 bits = 16x 12bit values
+Tlc5940Chain<NUM_TLCS> tlc_chain;
+#define tlc_GSData (tlc_chain.gsData)
+
+#if TLC_DOUBLE_BUFFER
+/** Front buffer: the frame that is being shifted out to the TLCs. update()
+    copies #tlc_GSData in here before it starts, so set() never touches data
+    the SPI/DMA is still reading. */
+unsigned int tlc_GSFront[NUM_TLCS * 6];
+#else
+#define tlc_GSFront tlc_GSData
+#endif
 
 
 #if VPRG_ENABLED
 
-/** Packed Dot Correction data. Packed similarly to GSData. Using an 8 bit uint because it's easier to pack. */
-uint8_t tlc_DCData[NUM_TLCS * 12];
+/** Packed Dot Correction data, 6 bits per channel and 3 words (96 bits) per TLC.
+    Packed like GSData, last channel first, so it can go out over SPI2 as it is. */
+unsigned int tlc_DCData[NUM_TLCS * 3];
 #endif 
 
+#if TLC_GAMMA_ENABLED
+/** Scales every value before the gamma table, 255 = full brightness */
+uint8_t tlc_brightness = 255;
+#endif
+
 /** This will be true (!= 0) if update was just called and the data has not
     been latched in yet. */
 volatile uint8_t tlc_needXLAT;
 
+/** This will be true (!= 0) while the DMA channel is still feeding
+    #tlc_GSFront to SPI2. */
+volatile uint8_t tlc_shifting;
+
 /** Some of the extened library will need to be called after a successful
     update. */
 volatile void (*tlc_onUpdateFinished)(void);
@@ -69,19 +130,33 @@ int Tlc5940::updateInProgress()
 	return tlc_needXLAT;
 }
 
+/** Returns where the last update() is: #TLC_UPDATE_SHIFTING while the data
+    is still being sent, #TLC_UPDATE_LATCHING until the XLAT pulse and
+    #TLC_UPDATE_IDLE once the TLCs have it. */
+int Tlc5940::updateStatus(void)
+{
+	if (tlc_shifting) {
+		return TLC_UPDATE_SHIFTING;
+	}
+	if (tlc_needXLAT) {
+		return TLC_UPDATE_LATCHING;
+	}
+	return TLC_UPDATE_IDLE;
+}
+
 void Tlc5940::init(int initialValue)
 {
 	//Setting Directionality of ports	
 	TRISFCLR = VPRG;
-	TRISGCLR = SOUT;
-	TRISGCLR = SCLK;
+	SOUT_TRISCLR = SOUT;
+	SCLK_TRISCLR = SCLK;
 	TRISDCLR = GSCLK;
 	TRISDCLR = BLANK;
 	TRISDCLR = XLAT;
 	
 	#if DATA_TRANSFER_MODE == TLC_BITBANG
 
-	#elif DATA_TRANSFER_MODE == TLC_SPI
+	#elif DATA_TRANSFER_MODE == TLC_SPI || DATA_TRANSFER_MODE == TLC_SPI_DMA
 	//Setting up SPI
 	OpenSPI2(
 			SPI_MODE32_ON
@@ -91,6 +166,16 @@ void Tlc5940::init(int initialValue)
 			| FRAME_ENABLE_OFF, 
 		SPI_ENABLE);
 	#endif
+
+	#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// Every time the SPI2 transmit buffer empties, the DMA channel moves the next word of
+	// tlc_GSFront into it. The block done interrupt then requests the XLAT pulse.
+	DmaChnOpen(GS_DMA_CHN, DMA_CHN_PRI3, DMA_OPEN_DEFAULT);
+	DmaChnSetEventControl(GS_DMA_CHN, DMA_EV_START_IRQ_EN | DMA_EV_START_IRQ(_SPI2_TX_IRQ));
+	DmaChnSetEvEnableFlags(GS_DMA_CHN, DMA_EV_BLOCK_DONE);
+	DmaChnSetIntPriority(GS_DMA_CHN, 3, 3);
+	DmaChnIntEnable(GS_DMA_CHN);
+	#endif
 	
 	// Start the timer for GSCLK
 	OpenTimer2(T2_ON | T2_PS_1_4, 0x3);
@@ -113,7 +198,7 @@ void Tlc5940::init(int initialValue)
 	
 	// Wait for the first update to be sent to the TLC before starting GSCLK
 	// so that the board doesn't start with random values
-	while(tlc_needXLAT);
+	while(tlc_needXLAT) { busy_wait(); }
 
 	// Start the OC for GSCLK
 	OpenOC1(OC_ON | OC_TIMER2_SRC | OC_PWM_FAULT_PIN_DISABLE, 0x1, 0x1);	
@@ -125,30 +210,55 @@ void Tlc5940::init(int initialValue)
     all the outputs. */
 void Tlc5940::clear(void)
 {
-    for(int i = 0; i < (NUM_TLCS * 6); i++) {
-		tlc_GSData[i] = 0x0;
-	}
+	memset(tlc_GSData, 0, sizeof(tlc_GSData));
+}
+
+/** Makes the back buffer, #tlc_GSData, the frame that update() sends */
+static void present_frame(void)
+{
+#if TLC_DOUBLE_BUFFER
+	memcpy(tlc_GSFront, tlc_GSData, sizeof(tlc_GSFront));
+#endif
 }
 
 #if DATA_TRANSFER_MODE == TLC_BITBANG
 
-// THIS FUNCTION IS CURRENTLY A BUCKET OF FAAAAAAAAAIL
+/** Shifts out bit of word: SOUT goes through its SET or CLR register and SCLK is
+    pulsed through its own, 3 writes and no read-modify-write of the port */
+#define BITBANG_BIT(word, bit) \
+	if ((word) & (1u << (bit))) { SOUT_PORTSET = SOUT; } else { SOUT_PORTCLR = SOUT; } \
+	SCLK_PORTSET = SCLK; \
+	SCLK_PORTCLR = SCLK;
+
+#define BITBANG_4(word, bit) \
+	BITBANG_BIT(word, bit) BITBANG_BIT(word, bit - 1) BITBANG_BIT(word, bit - 2) BITBANG_BIT(word, bit - 3)
+
+#define BITBANG_16(word, bit) \
+	BITBANG_4(word, bit) BITBANG_4(word, bit - 4) BITBANG_4(word, bit - 8) BITBANG_4(word, bit - 12)
+
+/** Shifts numWords of packed data out MSB first, 32 unrolled bits per word */
+static void bitbang_send(const unsigned int *data, int numWords)
+{
+	for (int i = 0; i < numWords; i++) {
+		unsigned int word = data[i];
+
+		BITBANG_16(word, 31)
+		BITBANG_16(word, 15)
+	}
+}
+
+/** Blocks until the data is out, like TLC_SPI */
 int Tlc5940::update(void)
 {
-	
-	for(int i = 0; i < (NUM_TLCS * 6); i++) {
-		for(int s = 31; s >= 0; s--)
-		{
-			if(tlc_GSData[i] >> s & 0x1) {
-				PORTGSET |= SOUT;
-			} else {
-				PORTGCLR |= SOUT;
-			}
-			
-			pulse_pin(SCLK_PORT, SCLK);
-		}
+	// We CANNOT use SOUT/SCLK while XLAT is high - tampering with the data while it's being latched is a BAD idea
+	if (tlc_needXLAT){
+		return 1; 
 	}
-	
+
+	present_frame();
+
+	bitbang_send(tlc_GSFront, NUM_TLCS * 6);
+
 	request_xlat_pulse();
 
 	return 0;
@@ -164,8 +274,10 @@ int Tlc5940::update(void)
 	}
 	pulse_pin(SCLK_PORT, SCLK);
 	
-	//TODO use Interrupt driven SPI for a non-blocking performance boost - this could get tricky when mixed with DC updates
-	putsSPI2(6 * NUM_TLCS, tlc_GSData);
+	present_frame();
+
+	// Blocks until the data is out. DATA_TRANSFER_MODE TLC_SPI_DMA sends it in the background instead
+	putsSPI2(6 * NUM_TLCS, tlc_GSFront);
 
 	// Wait for buffers to be emptied
 	while(SpiChnIsBusy(SPI_CHANNEL2));
@@ -175,9 +287,78 @@ int Tlc5940::update(void)
 	return 0;
 }
 
+#elif DATA_TRANSFER_MODE == TLC_SPI_DMA
+
+/** Starts sending #tlc_GSFront and returns straight away. The DMA interrupt
+    requests the XLAT pulse once the last word is handed to SPI2; use
+    updateStatus() or updateInProgress() to find out when it is done. */
+int Tlc5940::update(void)
+{
+	// We CANNOT use SOUT/SCLK while XLAT is high - tampering with the data while it's being latched is a BAD idea
+	if (tlc_needXLAT){
+		return 1; 
+	}
+	pulse_pin(SCLK_PORT, SCLK);
+
+	// Flag the update straight away so that nobody starts another one while the DMA is running
+	tlc_needXLAT = 1;
+	tlc_shifting = 1;
+
+	present_frame();
+
+	DmaChnSetTxfer(GS_DMA_CHN, tlc_GSFront, (void*)&SPI2BUF, NUM_TLCS * 24, 4, 4);
+	DmaChnStartTxfer(GS_DMA_CHN, DMA_WAIT_NOT, 0);
+
+	return 0;
+}
+
 #endif
 
 
+/** Grayscale values are 12 bits; anything bigger is clamped to 4095 */
+static inline unsigned int clamp12(unsigned int value)
+{
+	return (value > 4095) ? 4095 : value;
+}
+
+/** Maps a 0-4095 value through the brightness and the gamma table when
+    TLC_GAMMA_ENABLED is on. Called on everything that gets packed. */
+static inline unsigned int correct(unsigned int value)
+{
+#if TLC_GAMMA_ENABLED
+	return tlc_gammaTable[(value * (tlc_brightness + 1)) >> 8];
+#else
+	return value;
+#endif
+}
+
+/** Packs 8 channels into the 3 words that hold them. v[0] is the lowest of the
+    8 channels, which is stored last (case H), so this is the picture in set()
+    with all 8 cases done at once:
+      w[0] = |A|A|A|B|B|B|C|C|   w[1] = |C|D|D|D|E|E|E|F|   w[2] = |F|F|G|G|G|H|H|H| */
+static inline void pack8(unsigned int *w, const uint16_t *v)
+{
+	unsigned int v0 = clamp12(v[0]), v1 = clamp12(v[1]), v2 = clamp12(v[2]), v3 = clamp12(v[3]);
+	unsigned int v4 = clamp12(v[4]), v5 = clamp12(v[5]), v6 = clamp12(v[6]), v7 = clamp12(v[7]);
+
+	w[0] = v7 << 20 | v6 << 8 | v5 >> 4;
+	w[1] = v5 << 28 | v4 << 16 | v3 << 4 | v2 >> 8;
+	w[2] = v2 << 24 | v1 << 12 | v0;
+}
+
+/** The reverse of pack8() */
+static inline void unpack8(const unsigned int *w, uint16_t *v)
+{
+	v[7] = (w[0] >> 20) & 0xFFF;
+	v[6] = (w[0] >> 8) & 0xFFF;
+	v[5] = ((w[0] << 4) & 0xFF0) | (w[1] >> 28);
+	v[4] = (w[1] >> 16) & 0xFFF;
+	v[3] = (w[1] >> 4) & 0xFFF;
+	v[2] = ((w[1] << 8) & 0xF00) | (w[2] >> 24);
+	v[1] = (w[2] >> 12) & 0xFFF;
+	v[0] = w[2] & 0xFFF;
+}
+
 /** Sets channel to value in the grayscale data array, #tlc_GSData.
     \param channel (0 to #NUM_TLCS * 16 - 1).  OUT0 of the first TLC is
            channel 0, OUT0 of the next TLC is channel 16, etc.
@@ -191,80 +372,15 @@ void Tlc5940::set(int channel, int value)
 	if (value < 0 || value > 4095){
 		return;
 	}
-	// Data is packed into tlc_GSData as pictured below. 
-	// Each letter represents 4 bits and the last channel is stored first. 
-	// So |A|A|A| would be the 12-bit value of the last TLC channel
-	// 
-	// As picture below, there are 8 possible positions for the 12-bit value to be stored in the array (Cases A-H)
-	//	               _________________________________________________
-	//  Channel data: |A|A|A|B|B|B|C|C|C|D|D|D|E|E|E|F|F|F|G|G|G|H|H|H|
-	// 32-bit borders |‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|
-
-
-	// Since the last channel is stored first in the array, index32 is used as the inverse of channel
-	// i.e. assuming NUM_TLCs = 1, when channel = 15, then index32 = 0 and when channel = 0, then index32 = 15
-	unsigned int index32 = (NUM_TLCS * 16 - 1) - channel;
-
-	// index12p = index32 * 3 / 8 = the index into tlc_GSData where a 32-bit elment exists that will hold our 12-bit value
-	unsigned int *index12p = tlc_GSData + ((index32 * 3) >> 3);
-
-
-	// caseNum  = index32 mod 8 = which of the 8 possible cases we need to handle
-	int caseNum = index32 % 8;
-
-	switch(caseNum){
-		case 0:	// A: 12 bits start at the beginning of the element
-
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0x000FFFFF) | value << 20;
-			break;
-		case 1:	// B: 12 bits start 12 bits into the element
-
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xFFF000FF) | value << 8;
-			break;
-		case 2:	// C: 12 bits start 24 bits into the element and continue 4 bits into the next
-
-			// zero out the 8 bits that are in this element and OR them with the 8 MSB bits of value
-			*index12p = (*index12p & 0xFFFFFF00) | value >> 4;
-
-			// move to the next element, and zero out the remaining 4 bits, then OR them with the remaining 4 bits of value
-			index12p++;
-			*index12p = (*index12p & 0x0FFFFFFF) | value << 28;
-			break;
-		case 3:	// D: 12 bits start 4 bits into the element
-
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xF000FFFF) | value << 16; 			
-			break;
-		case 4: // E: 12 bits start 16 bits into the element
-
-			// zero out the 12 bits and OR those bits with the value
-			*index12p = (*index12p & 0xFFFF000F) | value << 4;
-			break;
-		case 5:	// F: 12 bits start 28 bits into the element and continue 8 bits into the next
-
-			// set the 4 bits that apply to this element
-			*index12p = (*index12p & 0xFFFFFFF0) | value >> 8;
-
-			// move to the next element, and set the appropriate bits
-			index12p++;
-			*index12p = (*index12p & 0x00FFFFFF) | value << 24;
-			break;
-		case 6:	// G: 12 bits start 8 bits into the element
-			*index12p = (*index12p & 0xFF000FFF) | value << 12;
-			break;
-		case 7:	// H: 12 bits start 20 bits into the element
-			*index12p = (*index12p & 0xFFFFF000) | value;
-			break;
-	}
+	tlc_chain.set(channel, correct(value));
 }
 
-// There is most certainly a faster way to do this, but this will work for now
 void Tlc5940::setAll(int value){
-	for (int i=0; i<NUM_TLCS*6; i++){
-		Tlc.set(i, value);
+	if (value < 0 || value > 4095){
+		return;
 	}
+
+	tlc_chain.setAll(correct(value));
 }
 
 #if RGB_ENABLED
@@ -300,79 +416,133 @@ int Tlc5940::getNumTLCs(){
 }
 
 
-/** The logic here is almost identical to the set function which is well documented */
 int Tlc5940::get(int channel){
+	return tlc_chain.get(channel);
+}
 
-	unsigned int index32 = (NUM_TLCS * 16 - 1) - channel;
-	unsigned int *index12p = tlc_GSData + ((index32 * 3) >> 3);
-	int caseNum = index32 % 8;
-	int value = 0;
-	
-	switch(caseNum){
-		case 0:
-			value |= (*index12p >> 20) & 0xFFF;
-			break;
-		case 1:
-			value |= (*index12p >> 8) & 0xFFF;
-			break;
-		case 2:
-			value |= (*index12p << 4) & 0xFF0;
-			index12p++;
-			value |= (*index12p >> 28) & 0xF;
-			break;
-		case 3:
-			value |= (*index12p >> 16) & 0xFFF;
-			break;
-		case 4:
-			value |= (*index12p >> 4) & 0xFFF;
-			break;
-		case 5:
-			value |= (*index12p << 8) & 0xF00;
-			index12p++;
-			value |= (*index12p >> 24) & 0xFF;
-			break;
-		case 6:
-			value |= (*index12p >> 12) & 0xFFF;
-			break;
-		case 7:
-			value |= *index12p & 0xFFF;
-			break;
+/** Sets count channels, starting at firstChannel, from values[0..count-1].
+    Whole groups of 8 channels (0-7, 8-15, ...) are packed straight into
+    #tlc_GSData three words at a time; only the channels at either end that
+    don't fill a group go through set(). Channels outside the chain are
+    skipped and values above 4095 are clamped.
+    \see getRange */
+void Tlc5940::setRange(int firstChannel, const uint16_t *values, int count)
+{
+	// Clip the range to the chain
+	if (firstChannel < 0) {
+		values -= firstChannel;
+		count += firstChannel;
+		firstChannel = 0;
+	}
+	if (count > NUM_TLCS * 16 - firstChannel) {
+		count = NUM_TLCS * 16 - firstChannel;
+	}
+	if (count <= 0) return;
+
+	int channel = firstChannel;
+	int lastChannel = firstChannel + count;
+
+	// Leading channels up to the first group boundary
+	while ((channel & 7) && (channel < lastChannel)) {
+		set(channel, clamp12(*values++));
+		channel++;
+	}
+
+	// Group g (channels 8g to 8g+7) lives in words 3 * (NUM_TLCS * 2 - 1 - g) onwards,
+	// so the groups are walked backwards through the array
+	while (channel + 8 <= lastChannel) {
+#if TLC_GAMMA_ENABLED
+		uint16_t corrected[8];
+		for (int i = 0; i < 8; i++) {
+			corrected[i] = correct(clamp12(values[i]));
+		}
+		pack8(tlc_GSData + 3 * (NUM_TLCS * 2 - 1 - (channel >> 3)), corrected);
+#else
+		pack8(tlc_GSData + 3 * (NUM_TLCS * 2 - 1 - (channel >> 3)), values);
+#endif
+		values += 8;
+		channel += 8;
+	}
+
+	// Whatever is left of the last group
+	while (channel < lastChannel) {
+		set(channel, clamp12(*values++));
+		channel++;
 	}
-	return value;
 }
 
+/** Reads count channels, starting at firstChannel, into values[0..count-1].
+    Channels outside the chain are skipped, leaving their values alone.
+    \see setRange */
+void Tlc5940::getRange(int firstChannel, uint16_t *values, int count)
+{
+	if (firstChannel < 0) {
+		values -= firstChannel;
+		count += firstChannel;
+		firstChannel = 0;
+	}
+	if (count > NUM_TLCS * 16 - firstChannel) {
+		count = NUM_TLCS * 16 - firstChannel;
+	}
+	if (count <= 0) return;
+
+	int channel = firstChannel;
+	int lastChannel = firstChannel + count;
+
+	while ((channel & 7) && (channel < lastChannel)) {
+		*values++ = get(channel++);
+	}
+
+	while (channel + 8 <= lastChannel) {
+		unpack8(tlc_GSData + 3 * (NUM_TLCS * 2 - 1 - (channel >> 3)), values);
+		values += 8;
+		channel += 8;
+	}
+
+	while (channel < lastChannel) {
+		*values++ = get(channel++);
+	}
+}
+
+#if TLC_GAMMA_ENABLED
+/** Sets the brightness (0-255, 255 is full) that every value is scaled by
+    before the gamma table. Only values set after this call are affected. */
+void Tlc5940::setBrightness(int brightness)
+{
+	if (brightness < 0 || brightness > 255){
+		return;
+	}
+	tlc_brightness = brightness;
+}
+#endif
+
 
 
 #if VPRG_ENABLED
 
 void Tlc5940::setDC(int channel, int value){
+	if (channel < 0 || channel >= NUM_TLCS * 16 || value < 0 || value > 63) {
+		return;
+	}
 
-	uint8_t index8 = (NUM_TLCS * 16 -1) - channel;
-	uint8_t *index6p = tlc_DCData + ((index8 * 3) >> 2);	// index * 3 / 4 = which array element the bits start it
-	int caseNum = index8 % 4; 
-	
-	switch(caseNum){
-		case 0:
-			*index6p = (*index6p & 0x03) | value << 2;
-			break;
-		case 1:
-			*index6p = (*index6p & 0xFC) | value >> 4;
-			index6p++;
-			*index6p = (*index6p & 0x0F) | value << 4;
-			break;
-		case 2:
-			*index6p = (*index6p & 0xF0) | value >> 2;
-			index6p++;
-			*index6p = (*index6p & 0x3F) | value << 6;
-			break;
-		case 3:
-			*index6p = (*index6p & 0xC0) | value;
-			break;
+	// Bit offset of the channel, counted from the MSB of the first word
+	unsigned int offset = ((NUM_TLCS * 16 - 1) - channel) * 6;
+	unsigned int *index32p = tlc_DCData + (offset >> 5);
+	int shift = offset & 31;
+
+	if (shift <= 26) {
+		// All 6 bits are in this word
+		*index32p = (*index32p & ~(0x3Fu << (26 - shift))) | (unsigned int)value << (26 - shift);
+	} else {
+		// The upper bits end this word and the lower bits start the next one
+		*index32p = (*index32p & ~(0x3Fu >> (shift - 26))) | (unsigned int)value >> (shift - 26);
+		index32p++;
+		*index32p = (*index32p & ~(0x3Fu << (58 - shift))) | (unsigned int)value << (58 - shift);
 	}
 }
 
 void Tlc5940::setAllDC(int value){
-	for (int i=0; i<NUM_TLCS; i++){
+	for (int i=0; i<NUM_TLCS * 16; i++){
 		setDC(i, value);
 	}
 }
@@ -380,33 +550,19 @@ void Tlc5940::setAllDC(int value){
 
 int Tlc5940::getDC(int channel){
 
-	uint8_t index8 = (NUM_TLCS * 16 -1) - channel;
-	uint8_t *index6p = tlc_DCData + ((index8 * 3) >> 2);	// index * 3 / 4 = which array element the bits start it
-	int caseNum = index8 % 4; 
-	int value = 0;
-	
-	switch (caseNum){
-		case 0:
-			value |= (*index6p >> 2) & 0x3F;
-			break;
-		case 1:
-			value |= (*index6p << 4) & 0x30;
-			index6p++;
-			value |= (*index6p >> 4) & 0x0F;
-			break;
-		case 2:
-			value |= (*index6p << 2) & 0x3C;
-			index6p++;
-			value |= (*index6p >> 6) & 0x03;
-			break;
-		case 3:
-			value |= (*index6p & 0x3F);
-			break;
+	unsigned int offset = ((NUM_TLCS * 16 - 1) - channel) * 6;
+	unsigned int *index32p = tlc_DCData + (offset >> 5);
+	int shift = offset & 31;
+
+	if (shift <= 26) {
+		return (*index32p >> (26 - shift)) & 0x3F;
 	}
-	return value;
+	return ((index32p[0] << (shift - 26)) | (index32p[1] >> (58 - shift))) & 0x3F;
 }
 
-/** Send the bits for Dot Correction to the TLC*/
+/** Send the bits for Dot Correction to the TLC. Uses the same path as the
+    grayscale data, so with TLC_SPI_DMA it returns straight away; the XLAT
+    interrupt drops VPRG again once the TLCs have latched it. */
 int Tlc5940::updateDC(){
 
 	// if needXLAT, there is already an update in process
@@ -414,30 +570,33 @@ int Tlc5940::updateDC(){
 		return 1;
 	}
 
-
 	// Set VPRG High to switch to DC programming mode
 	setHigh(VPRG_PORT, VPRG);
-		
-	// SPI didn't work out so well since I'm using an array of uint8_t
-	// So let's try bit banging
-	for(int i = 0; i < (NUM_TLCS * 12); i++) {
-		for(int s = 7; s >= 0; s--)
-		{
-			if(tlc_DCData[i] >> s & 0x1) {
-				setHigh(SOUT_PORT, SOUT);
-			} else {
-				setLow(SOUT_PORT, SOUT);
-			}
-			
-			pulse_pin(SCLK_PORT, SCLK);
-		}
-	}
+
+#if DATA_TRANSFER_MODE == TLC_BITBANG
+	bitbang_send(tlc_DCData, NUM_TLCS * 3);
+	request_xlat_pulse();
+
+#elif DATA_TRANSFER_MODE == TLC_SPI
+	// 96 bits per TLC, 3 words
+	putsSPI2(NUM_TLCS * 3, tlc_DCData);
+	while(SpiChnIsBusy(SPI_CHANNEL2));
+
 	request_xlat_pulse();
 
+#elif DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// The DMA interrupt requests the XLAT pulse, just like it does for update()
+	tlc_needXLAT = 1;
+	tlc_shifting = 1;
+
+	DmaChnSetTxfer(GS_DMA_CHN, tlc_DCData, (void*)&SPI2BUF, NUM_TLCS * 12, 4, 4);
+	DmaChnStartTxfer(GS_DMA_CHN, DMA_WAIT_NOT, 0);
+#endif
+
 	return 0;
 }
 
-uint8_t* Tlc5940::getDCData(){
+unsigned int* Tlc5940::getDCData(){
 	return tlc_DCData;
 }
 #endif
@@ -458,8 +617,8 @@ but at least this way we have an entire cycle to setup the XLAT pulse. If we dec
 setup XLAT immediately, we would run the risk of setting XLAT right in the middle of when
 it was supposed to be checked and we could run into some nasty race conditions. 
 */
-void Tlc5940::request_xlat_pulse(){
-
+static void xlat_on_next_blank(void)
+{
 	// Set this flag so that we can keep track of whether or not we are waiting for an XLAT pulse
 	tlc_needXLAT = 1;
 
@@ -467,6 +626,10 @@ void Tlc5940::request_xlat_pulse(){
 	ConfigIntOC5(OC_INT_ON | OC_INT_PRIOR_3 | OC_INT_SUB_PRI_3);
 }
 
+void Tlc5940::request_xlat_pulse(){
+	xlat_on_next_blank();
+}
+
 #ifdef __cplusplus
 extern "C"	// So c++ doesn't mangle the function names
 {
@@ -494,13 +657,19 @@ extern "C"	// So c++ doesn't mangle the function names
 		mOC4ClearIntFlag();
 
 
-/*
-		// If VPRG is High, then we just programmed DC
+		// If VPRG is High, then we just programmed DC. The TLCs swallow the first SCLK
+		// after a DC latch, so give them that one now. SPI2 owns the SCLK pin in the SPI
+		// modes, so there it is a dummy word: its bits go into the GS shift register and
+		// are pushed out the end by the next update.
 		if (outputState(VPRG_PORT, VPRG)){
 			setLow(VPRG_PORT, VPRG);
-			pulse_pin(SCLK_PORT, SCLK);
+#if DATA_TRANSFER_MODE == TLC_BITBANG
+			SCLK_PORTSET = SCLK;
+			SCLK_PORTCLR = SCLK;
+#else
+			putcSPI2(0);
+#endif
 		}
-		*/
 		
 		if (tlc_onUpdateFinished) {
 		    tlc_onUpdateFinished();
@@ -508,6 +677,21 @@ extern "C"	// So c++ doesn't mangle the function names
 		//OpenTimer2(T2_ON | T2_PS_1_4, 0x3);
 	}
 
+#if DATA_TRANSFER_MODE == TLC_SPI_DMA
+	// Handle the interrupt triggered when the DMA has handed the last word to SPI2.
+	// The last word is still shifting out, but it only takes 32 SCLKs and the XLAT
+	// pulse is at least one whole BLANK cycle away.
+	void __ISR(_DMA_0_VECTOR, ipl3) IntDMA0Handler(void)
+	{
+		DmaChnClrEvFlags(GS_DMA_CHN, DMA_EV_ALL_EVNTS);
+		DmaChnClrIntFlag(GS_DMA_CHN);
+
+		tlc_shifting = 0;
+
+		xlat_on_next_blank();
+	}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,6 +5,11 @@
 
 //extern unsigned int tlc_GSData[NUM_TLCS * 6];
 
+/** Values returned by updateStatus() */
+#define TLC_UPDATE_IDLE			0	// Nothing in flight, set() and update() are safe
+#define TLC_UPDATE_SHIFTING		1	// Grayscale data is still going out over SPI
+#define TLC_UPDATE_LATCHING		2	// Data is shifted in, waiting for the XLAT pulse
+
 class Tlc5940
 {
   public:
@@ -14,7 +19,13 @@ class Tlc5940
 	void set(int channel, int value);
 	int get(int channel);
 	void setAll(int value);
+	void setRange(int firstChannel, const uint16_t *values, int count);
+	void getRange(int firstChannel, uint16_t *values, int count);
+#if TLC_GAMMA_ENABLED
+	void setBrightness(int brightness);
+#endif
 	int updateInProgress(void);
+	int updateStatus(void);
 	int getNumTLCs();
 	void setRGB1(int channel, int r, int g, int b);
 	void setRGB2(int channel, int r, int g, int b);
@@ -25,7 +36,7 @@ class Tlc5940
 	void setDC(int channel, int value);
 	int getDC(int channel);
 	int updateDC();
-	uint8_t* getDCData();
+	unsigned int* getDCData();
     //void setAllDC(uint8_t r, uint8_t g, uint8_t b);
     //void setAllDCtest(uint8_t r, uint8_t g, uint8_t b);
 #endif
@@ -0,0 +1,175 @@
+/** Tlc5940Chain<NumTLCs, Wiring>: the packed grayscale data of one daisy chain.
+
+    Each chain owns its own buffer, so chains of different lengths can live in
+    the same sketch, whatever NUM_TLCS is set to in tlc_config.h. The Tlc
+    variable keeps its data in a Tlc5940Chain<NUM_TLCS>, and the LEDCube
+    library packs its layers with it too (LEDCube_chain.h includes this file),
+    so this file doesn't read either library's config.
+
+    Data is packed into the buffer as pictured below. Each letter represents
+    4 bits and the last channel is stored first, so |A|A|A| is the 12-bit value
+    of the last channel of the chain. There are 8 possible positions for a
+    12-bit value (A-H), and two of them (C and F) are split over two words:
+                   _________________________________________________
+      Channel data: |A|A|A|B|B|B|C|C|C|D|D|D|E|E|E|F|F|F|G|G|G|H|H|H|
+    32-bit borders  |‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾|
+
+    The compiler works out the word, shift and split of every channel into a
+    table in flash, so set() and get() are one lookup and a shift instead of
+    the index * 3 / 8 and % 8 cases. Needs a C++11 compiler (-std=gnu++11). */
+
+#ifndef TLC5940_CHAIN_H
+#define TLC5940_CHAIN_H
+
+#include <stdint.h>
+
+#if __cplusplus < 201103L
+	#error "Tlc5940Chain.h needs a C++11 compiler (-std=gnu++11)"
+#endif
+
+/** Where a channel's 12 bits are in the buffer. If split is 0 the value is
+    at (word, shift); if it is 1 the upper bits are the low end of word
+    (value >> shift) and the rest the top of word + 1 (value << 32 - shift). */
+struct TlcChannelPos {
+	uint16_t word;
+	uint8_t shift;
+	uint8_t split;
+};
+
+/** Wiring: OUT0 of the TLC nearest the chipKIT is channel 0, OUT0 of the
+    next TLC is channel 16, etc. */
+struct TlcStraightWiring {
+	static constexpr int physical(int channel, int /* numTLCs */)
+	{
+		return channel;
+	}
+};
+
+/** Wiring for a chain fed from the other end: channel 0 is OUT0 of the TLC
+    furthest from the chipKIT. */
+struct TlcReversedWiring {
+	static constexpr int physical(int channel, int numTLCs)
+	{
+		return (numTLCs - 1 - (channel >> 4)) * 16 + (channel & 15);
+	}
+};
+
+/** Position of the value that starts bit bits into the buffer (from the MSB of word 0) */
+constexpr TlcChannelPos tlc_chain_bitPos(int bit)
+{
+	return ((bit & 31) <= 20) ? TlcChannelPos{ (uint16_t)(bit >> 5), (uint8_t)(20 - (bit & 31)), 0 }
+	                          : TlcChannelPos{ (uint16_t)(bit >> 5), (uint8_t)((bit & 31) - 20), 1 };
+}
+
+/** Position of a physical channel; the last channel is stored first */
+constexpr TlcChannelPos tlc_chain_channelPos(int physical, int numTLCs)
+{
+	return tlc_chain_bitPos((numTLCs * 16 - 1 - physical) * 12);
+}
+
+/** TlcChainIndexes<0, 1, ..., N - 1> built by doubling, so the template depth
+    stays at about 2 * log2(N) */
+template<int... I> struct TlcChainIndexes {
+	typedef TlcChainIndexes<I..., (int)sizeof...(I) + I...> doubled;
+	typedef TlcChainIndexes<I..., (int)sizeof...(I)> plusOne;
+};
+
+template<int N, bool Odd = ((N & 1) != 0)> struct TlcChainMakeIndexes {
+	typedef typename TlcChainMakeIndexes<N / 2>::type::doubled type;
+};
+
+template<int N> struct TlcChainMakeIndexes<N, true> {
+	typedef typename TlcChainMakeIndexes<(N - 1)>::type::plusOne type;
+};
+
+template<> struct TlcChainMakeIndexes<0, false> {
+	typedef TlcChainIndexes<> type;
+};
+
+template<int NumTLCs, typename Wiring, typename Indexes> struct TlcChainTable;
+
+template<int NumTLCs, typename Wiring, int... I> struct TlcChainTable<NumTLCs, Wiring, TlcChainIndexes<I...> > {
+	static const TlcChannelPos positions[sizeof...(I)];
+};
+
+template<int NumTLCs, typename Wiring, int... I>
+const TlcChannelPos TlcChainTable<NumTLCs, Wiring, TlcChainIndexes<I...> >::positions[sizeof...(I)] = {
+	tlc_chain_channelPos(Wiring::physical(I, NumTLCs), NumTLCs)...
+};
+
+template<int NumTLCs, typename Wiring = TlcStraightWiring>
+class Tlc5940Chain
+{
+  public:
+	enum {
+		numChannels = NumTLCs * 16,
+		numWords = NumTLCs * 6		// 6 * 32 = 192 bits = 16x 12bit values per TLC
+	};
+
+	typedef TlcChainTable<NumTLCs, Wiring, typename TlcChainMakeIndexes<NumTLCs * 16>::type> Table;
+
+	/** Sets channel (0 to numChannels - 1) to value (0-4095). Nothing is checked. */
+	void set(int channel, unsigned int value)
+	{
+		pack(gsData, channel, value);
+	}
+
+	int get(int channel) const
+	{
+		return unpack(gsData, channel);
+	}
+
+	/** One value repeats every 8 channels, so it is packed into 3 words once
+	    and those are copied over the whole buffer */
+	void setAll(unsigned int value)
+	{
+		unsigned int words[3];
+
+		words[0] = value << 20 | value << 8 | value >> 4;
+		words[1] = value << 28 | value << 16 | value << 4 | value >> 8;
+		words[2] = value << 24 | value << 12 | value;
+
+		for (int i = 0; i < numWords; i += 3) {
+			gsData[i] = words[0];
+			gsData[i + 1] = words[1];
+			gsData[i + 2] = words[2];
+		}
+	}
+
+	void clear(void)
+	{
+		for (int i = 0; i < numWords; i++) {
+			gsData[i] = 0;
+		}
+	}
+
+	/** Writes a channel into any buffer laid out like gsData, e.g. one layer of a cube */
+	static void pack(unsigned int *words, int channel, unsigned int value)
+	{
+		const TlcChannelPos &pos = Table::positions[channel];
+		unsigned int *w = words + pos.word;
+
+		if (!pos.split) {
+			*w = (*w & ~(0xFFFu << pos.shift)) | value << pos.shift;
+		} else {
+			w[0] = (w[0] & ~(0xFFFu >> pos.shift)) | value >> pos.shift;
+			w[1] = (w[1] & ~(0xFFFu << (32 - pos.shift))) | value << (32 - pos.shift);
+		}
+	}
+
+	static int unpack(const unsigned int *words, int channel)
+	{
+		const TlcChannelPos &pos = Table::positions[channel];
+		const unsigned int *w = words + pos.word;
+
+		if (!pos.split) {
+			return (*w >> pos.shift) & 0xFFF;
+		}
+		return ((w[0] << pos.shift) | (w[1] >> (32 - pos.shift))) & 0xFFF;
+	}
+
+	/** Packed data, in the order it is shifted out to the TLCs */
+	unsigned int gsData[NumTLCs * 6];
+};
+
+#endif
@@ -8,6 +8,9 @@
 /** Use the much faster hardware SPI module */
 #define TLC_SPI            2
 
+/** Hardware SPI fed by a DMA channel, so update() doesn't block */
+#define TLC_SPI_DMA        3
+
 #ifndef TLC_SPI_PRESCALER_FLAGS
 	#define TLC_SPI_PRESCALER_FLAGS PRI_PRESCAL_4_1|SEC_PRESCAL_4_1
 #endif
@@ -19,10 +22,47 @@
 
 /** Determines how data should be transfered to the TLCs.  Bit-banging can use
     any two i/o pins, but the hardware SPI is faster.
-    - Bit-Bang = TLC_BITBANG --> *NOT YET WORKING* 
-    - Hardware SPI = TLC_SPI (default) */
+    - Bit-Bang = TLC_BITBANG
+    - Hardware SPI = TLC_SPI
+    - Hardware SPI with DMA = TLC_SPI_DMA (default) */
 #ifndef DATA_TRANSFER_MODE
-	#define DATA_TRANSFER_MODE TLC_SPI
+	#define DATA_TRANSFER_MODE TLC_SPI_DMA
+#endif
+
+/** Pins used by DATA_TRANSFER_MODE TLC_BITBANG: any two outputs, given as the port
+    letter and the bit. The defaults are the SPI2 pins (SIN = RG8, pin 11 and
+    SCLK = RG6, pin 13), so the wiring is the same as for TLC_SPI. */
+#ifndef TLC_BITBANG_SIN_PORT
+	#define TLC_BITBANG_SIN_PORT	G
+#endif
+#ifndef TLC_BITBANG_SIN
+	#define TLC_BITBANG_SIN			0x100
+#endif
+#ifndef TLC_BITBANG_SCLK_PORT
+	#define TLC_BITBANG_SCLK_PORT	G
+#endif
+#ifndef TLC_BITBANG_SCLK
+	#define TLC_BITBANG_SCLK		0x40
+#endif
+
+/** Send a copy of the grayscale data instead of the array set() writes to,
+    so that set() can be called again while an update is still in flight.
+    Costs a second copy of the grayscale data in RAM. */
+#ifndef TLC_DOUBLE_BUFFER
+	#define TLC_DOUBLE_BUFFER		1
+#endif
+
+/** Map every value through a gamma curve and a brightness setting when it is
+    packed by set()/setRange()/setAll(), so that fades look even to the eye.
+    The 4096 entry table is built by the compiler (see tlc_gamma.h, needs
+    C++11) and takes 8KB of flash. get() returns the corrected value. */
+#ifndef TLC_GAMMA_ENABLED
+	#define TLC_GAMMA_ENABLED		0
+#endif
+
+/** Exponent of the gamma curve. 1.0 gives a straight line (brightness only). */
+#ifndef TLC_GAMMA
+	#define TLC_GAMMA				2.2
 #endif
 
 /** Defines whether or not you will be able to set Dot Correction
@@ -0,0 +1,89 @@
+/** Gamma tables, for TLC_GAMMA_ENABLED (see tlc_config.h) and for the LEDCube
+    library's CUBE_GAMMA_ENABLED (LEDCube_gamma.h includes this file).
+
+    TLC_GAMMA_TABLE(gamma)[v] = round(4095 * (v / 4095) ^ gamma) for v = 0 to 
+    4095. The compiler works the whole table out from the constexpr functions
+    below, so it ends up in flash and the chipKIT never does any floating point
+    math for it. This file doesn't read either library's config, so both can
+    use it. Needs a C++11 compiler (-std=gnu++11). */
+
+#ifndef TLC_GAMMA_H
+#define TLC_GAMMA_H
+
+#include <stdint.h>
+
+#if __cplusplus < 201103L
+	#error "tlc_gamma.h (TLC_GAMMA_ENABLED / CUBE_GAMMA_ENABLED) needs a C++11 compiler (-std=gnu++11)"
+#endif
+
+/** ln(x) = 2 * (z + z^3/3 + z^5/5 + ...) with z = (x - 1) / (x + 1). z is at
+    most 1/3 here, so 21 terms are plenty. */
+constexpr double tlc_gamma_lnSeries(double z2, double term, int k)
+{
+	return (k > 41) ? 0.0 : term / k + tlc_gamma_lnSeries(z2, term * z2, k + 2);
+}
+
+constexpr double tlc_gamma_lnReduced(double z)
+{
+	return 2.0 * tlc_gamma_lnSeries(z * z, z, 1);
+}
+
+/** ln(x) for 0 < x <= 1. x is doubled into [0.5, 1] first. */
+constexpr double tlc_gamma_ln(double x)
+{
+	return (x < 0.5) ? tlc_gamma_ln(x * 2.0) - 0.69314718055994531
+	                 : tlc_gamma_lnReduced((x - 1.0) / (x + 1.0));
+}
+
+/** e^y = 1 + y + y^2/2! + ... */
+constexpr double tlc_gamma_expSeries(double y, double term, int k)
+{
+	return (k > 20) ? term : term + tlc_gamma_expSeries(y, term * y / k, k + 1);
+}
+
+constexpr double tlc_gamma_square(double x)
+{
+	return x * x;
+}
+
+/** e^y for y <= 0. y is halved down to [-0.5, 0] and the result squared back up. */
+constexpr double tlc_gamma_exp(double y)
+{
+	return (y < -0.5) ? tlc_gamma_square(tlc_gamma_exp(y * 0.5))
+	                  : tlc_gamma_expSeries(y, 1.0, 1);
+}
+
+/** The gamma is passed in thousandths, as a template can't take a double */
+constexpr uint16_t tlc_gamma_value(int gammaMilli, int v)
+{
+	return (v == 0) ? 0 : (uint16_t)(4095.0 * tlc_gamma_exp(gammaMilli / 1000.0 * tlc_gamma_ln(v / 4095.0)) + 0.5);
+}
+
+/** TlcGammaIndexes<0, 1, ..., 4095> built by doubling, so the template depth
+    stays at 12 */
+template<int... I> struct TlcGammaIndexes {
+	typedef TlcGammaIndexes<I..., (int)sizeof...(I) + I...> doubled;
+};
+
+template<int N> struct TlcGammaMakeIndexes {
+	typedef typename TlcGammaMakeIndexes<N / 2>::type::doubled type;
+};
+
+template<> struct TlcGammaMakeIndexes<1> {
+	typedef TlcGammaIndexes<0> type;
+};
+
+template<int GammaMilli, typename Indexes> struct TlcGammaTable;
+
+template<int GammaMilli, int... I> struct TlcGammaTable<GammaMilli, TlcGammaIndexes<I...> > {
+	static const uint16_t values[sizeof...(I)];
+};
+
+template<int GammaMilli, int... I> const uint16_t TlcGammaTable<GammaMilli, TlcGammaIndexes<I...> >::values[sizeof...(I)] = {
+	tlc_gamma_value(GammaMilli, I)...
+};
+
+/** The table for a gamma given as a double constant, e.g. TLC_GAMMA_TABLE(2.2) */
+#define TLC_GAMMA_TABLE(gamma)	(TlcGammaTable<(int)((gamma) * 1000.0 + 0.5), TlcGammaMakeIndexes<4096>::type>::values)
+
+#endif